@@ -24,11 +24,22 @@
  */
 
 #include <atomic>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <unistd.h>
 
 #include "FPTree.hpp"
 
 #include <gimlet/json_parser.hpp>
 #include <gimlet/data_iterator.hpp>
+#include <gimlet/mapped_file.hpp>
+#include <gimlet/compressed_input.hpp>
 
 
 namespace gimlet {	
@@ -129,26 +140,27 @@ namespace gimlet {
     }
 
     void FPTree::skip(Group& group) {
-      for(Level* level : group) {
-	threads_.emplace_back([level]() {
-	    auto it = level->begin(), end = level->end();	  
-	    for(; it != end; ++it)
-	      it->part_ = it->parent_->part_;
-	  });
-      }
-      threads_.join();
+      cool::parallel_for_each(threads_, group.begin(), group.end(),
+			      [] (Level* level) {
+				auto it = level->begin(), end = level->end();	  
+				for(; it != end; ++it)
+				  it->part_ = it->parent_->part_;
+			      },
+			      [] (const Level* level) { return static_cast<size_t>(level->size_); },
+			      minSkipChunk_);
     }
     
-    FPTree::FPTree(int target, size_t nThreads) :
-      threads_(nThreads),
+    FPTree::FPTree(int target, size_t nThreads, bool pinned) :
+      threads_(nThreads, pinned),
       levels_(), groups_(),
-      pool_(new boost::object_pool<Node>()),
+      pool_(new node_pool_t()),
       size_(0), nbrNodes_(0),
       root_(nullptr, 0),
       rootLevel_(),
       rootGroup_(&root_, &rootLevel_),
       targetEntropy_(0.), targetGroup_(),
-      target_(target)
+      target_(target),
+      dictionary_()
     {
     }
 
@@ -164,6 +176,14 @@ namespace gimlet {
       return groups_.size();
     }    
 
+    size_t FPTree::minValues() const {
+      size_t minValues = 0;
+      for(const Group* group : sortedGroups_)
+	if(group != targetGroup_ && group->size() > 1 && (minValues == 0 || group->size() < minValues))
+	  minValues = group->size();
+      return minValues == 0 ? 2 : minValues;
+    }
+
     class FPTree::Iterator {
       using pattern_type = std::vector<pair_type>;
     public:
@@ -270,7 +290,13 @@ namespace gimlet {
     }
     
     FPTree::Node* FPTree::addNode(const pair_type& attr, Node* parent) {
-      Level& lvl = this->level(attr);
+      return addNode(this->level(attr), parent);
+    }
+
+    FPTree::Node* FPTree::addNode(Level& lvl, Node* parent) {
+      // The pool doubles its blocks: stop doing so close to the memory limit
+      if(pool_->get_next_size() > minPoolBlock_ && cool::MemoryBudget::instance().nearLimit(pool_->get_next_size() * sizeof(Node)))
+	pool_->set_next_size(minPoolBlock_);
       Node* node = pool_->construct(parent, 0);
       ++nbrNodes_;
       node->part_ = lvl.part_;
@@ -279,7 +305,10 @@ namespace gimlet {
       return node;
     }
 
-    void FPTree::build(std::vector<pattern_type>& data) {
+    template<typename Value>
+    void FPTree::build(std::vector<valued_row_type<Value>>& data) {
+      using pattern_type = valued_row_type<Value>;
+
       auto difference = [] (const pattern_type& p1, const pattern_type &p2) -> int {
 	auto b1 = p1.begin(), e1 = p1.end();
 	auto b2 = p2.begin(), e2 = p2.end();
@@ -402,15 +431,320 @@ namespace gimlet {
 	group->reserveMaxPartNumber();
     }
 
+    template void FPTree::build(std::vector<valued_row_type<std::uint8_t>>&);
+    template void FPTree::build(std::vector<valued_row_type<std::uint16_t>>&);
+    template void FPTree::build(std::vector<valued_row_type<std::uint32_t>>&);
+
     double FPTree::targetEntropy() const { return targetEntropy_; }
 
     void FPTree::build(std::istream& is) {
-      auto JSON_parser = gimlet::make_JSON_parser<flow<pattern_type>>();
-      auto input_stream = gimlet::make_input_data_stream(is, JSON_parser);
-      auto begin = gimlet::make_input_data_begin<decltype(input_stream), pattern_type>(input_stream);
-      auto end = gimlet::make_input_data_end<decltype(input_stream), pattern_type>(input_stream);
+      read_rows(is, [this] (auto begin, auto end) { build(begin, end); }, dictionary_);
+    }
+
+    const Dictionary& FPTree::dictionary() const { return dictionary_; }
+
+    namespace {
+      // First bytes of tree images, the last one being the version of their layout
+      constexpr char imageMagic[8] = { 'F', 'P', 'T', 'R', 'E', 'E', '\0', '\2' };
+
+      struct ImageHeader {
+	char magic_[8];
+	std::uint64_t key_;
+	std::int64_t target_;
+	double targetEntropy_;
+	std::uint64_t size_, nGroups_, nLevels_, nNodes_, dictionarySize_;
+	std::uint64_t rootCount_, rootPartCount_;
+	// Hash of all the bytes following the header
+	std::uint64_t checksum_;
+      };
+
+      struct GroupImage {
+	double H_;
+	std::uint32_t var_, nLevels_;
+      };
+
+      /* Padded explicitly so that images and their checksums only depend on the tree */
+      struct LevelImage {
+	FPTree::count_type count_, partCount_;
+	std::uint32_t value_, padding_;
+      };
+
+      /* Parents are 0 for the root and i + 1 for the i-th node of the image */
+      struct NodeImage {
+	std::uint32_t parent_, level_, count_;
+      };
+
+      template<typename Record>
+      Record readRecord(const char*& data) {
+	Record record;
+	std::memcpy(&record, data, sizeof(Record));
+	data += sizeof(Record);
+	return record;
+      }
+
+      template<typename Record>
+      void writeRecord(std::ostream& os, const Record& record) {
+	os.write(reinterpret_cast<const char*>(&record), sizeof(Record));
+      }
+
+      void writeString(std::ostream& os, const std::string& str) {
+	writeRecord(os, static_cast<std::uint32_t>(str.size()));
+	os.write(str.data(), str.size());
+      }
+
+      bool readString(const char*& data, const char* end, std::string& str) {
+	if(end - data < static_cast<std::ptrdiff_t>(sizeof(std::uint32_t))) return false;
+	const std::uint32_t size = readRecord<std::uint32_t>(data);
+	if(static_cast<size_t>(end - data) < size) return false;
+	str.assign(data, size);
+	data += size;
+	return true;
+      }
+
+      bool readDictionary(const char* data, const char* end, Dictionary& dictionary) {
+	if(end - data < static_cast<std::ptrdiff_t>(sizeof(std::uint32_t))) return false;
+	const std::uint32_t nNames = readRecord<std::uint32_t>(data);
+	// Every name takes at least its size
+	if(static_cast<size_t>(end - data) / sizeof(std::uint32_t) < nNames) return false;
+	dictionary.names_.resize(nNames);
+	dictionary.values_.resize(nNames);
+	for(size_t i = 0; i != nNames; ++i) {
+	  if(! readString(data, end, dictionary.names_[i])) return false;
+	  if(end - data < static_cast<std::ptrdiff_t>(sizeof(std::uint32_t))) return false;
+	  const std::uint32_t nValues = readRecord<std::uint32_t>(data);
+	  if(static_cast<size_t>(end - data) / sizeof(std::uint32_t) < nValues) return false;
+	  dictionary.values_[i].resize(nValues);
+	  for(std::string& value : dictionary.values_[i])
+	    if(! readString(data, end, value)) return false;
+	}
+	return data == end;
+      }
+
+      /* FNV-1a over the 64-bit words of [begin, end), with a shift spreading the high bits of every word */
+      class WordHash {
+	std::uint64_t hash_ = 0xcbf29ce484222325ULL;
+      public:
+	void add(std::uint64_t word) {
+	  hash_ = (hash_ ^ word) * 0x100000001b3ULL;
+	  hash_ ^= hash_ >> 29;
+	}
+	void add(const char* begin, const char* end) {
+	  while(end - begin >= 8) add(readRecord<std::uint64_t>(begin));
+	  std::uint64_t tail = 0;
+	  if(begin != end) std::memcpy(&tail, begin, end - begin);
+	  add(tail);
+	}
+	operator std::uint64_t() const { return hash_; }
+      };
+
+      /* Key of the images of the trees built from a file for a target: hash of both, of the size and of the modification time of the file */
+      std::uint64_t imageKey(const std::string& fileName, int target) {
+	cool::MappedFile file(fileName);
+	WordHash hash;
+	hash.add(file.begin(), file.end());
+	hash.add(file.size());
+	hash.add(static_cast<std::uint64_t>(std::filesystem::last_write_time(fileName).time_since_epoch().count()));
+	hash.add(static_cast<std::uint64_t>(static_cast<std::int64_t>(target)));
+	return hash;
+      }
+    }
+
+    std::string& FPTree::imageDirectory() {
+      static std::string directory;
+      return directory;
+    }
+
+    void FPTree::build(const std::string& fileName) {
+      // Images are keyed by the contents of regular files only
+      if(imageDirectory().empty() || fileName.empty() || ! std::filesystem::is_regular_file(fileName)) {
+	cool::InputFile is(fileName);
+	build(is);
+	return;
+      }
+      const std::uint64_t key = imageKey(fileName, target_);
+      std::ostringstream name;
+      name << std::hex << std::setfill('0') << std::setw(16) << key << ".fptree";
+      const std::string image = (std::filesystem::path(imageDirectory()) / name.str()).string();
+      if(load(image, key)) return;
+      {
+	cool::InputFile is(fileName);
+	build(is);
+      }
+      std::filesystem::create_directories(imageDirectory());
+      save(image, key);
+    }
+
+    void FPTree::save(const std::string& fileName, std::uint64_t key) const {
+      // Nodes of images are numbered on 32 bits
+      if(nbrNodes_ >= std::numeric_limits<std::uint32_t>::max()) return;
+
+      std::vector<GroupImage> groups;
+      std::vector<LevelImage> levels;
+      std::vector<NodeImage> nodes;
+      std::unordered_map<const Node*, std::uint32_t> nodeIds;
+      nodes.reserve(nbrNodes_);
+      nodeIds.reserve(nbrNodes_);
+      std::vector<const Node*> levelNodes;
+      for(const Group* group : sortedGroups_) {
+	groups.push_back({ group->H_, group->var_, static_cast<std::uint32_t>(group->size()) });
+	for(size_t i = 0; i != group->size(); ++i) {
+	  const Level* level = (*group)[i];
+	  const std::uint32_t levelId = static_cast<std::uint32_t>(levels.size());
+	  // Parts were moved when reserved: the part of level i is the i-th one
+	  levels.push_back({ level->count_, group->parts_[i].count_, level->attr_.second, 0 });
+	  // Nodes are pushed in front of their level: write them in insertion order
+	  levelNodes.clear();
+	  for(const Node* node : *level) levelNodes.push_back(node);
+	  for(auto it = levelNodes.rbegin(); it != levelNodes.rend(); ++it) {
+	    const Node* node = *it;
+	    const std::uint32_t parent = node->parent_ == &root_ ? 0 : nodeIds.at(node->parent_);
+	    nodes.push_back({ parent, levelId, node->count_ });
+	    nodeIds.emplace(node, static_cast<std::uint32_t>(nodes.size()));
+	  }
+	}
+      }
+
+      std::ostringstream dictionary;
+      writeRecord(dictionary, static_cast<std::uint32_t>(dictionary_.names_.size()));
+      for(size_t i = 0; i != dictionary_.names_.size(); ++i) {
+	writeString(dictionary, dictionary_.names_[i]);
+	const std::vector<std::string> noValues;
+	const std::vector<std::string>& values = i < dictionary_.values_.size() ? dictionary_.values_[i] : noValues;
+	writeRecord(dictionary, static_cast<std::uint32_t>(values.size()));
+	for(const std::string& value : values) writeString(dictionary, value);
+      }
+      const std::string dictionaryData = dictionary.str();
+
+      ImageHeader header{};
+      std::memcpy(header.magic_, imageMagic, sizeof(imageMagic));
+      header.key_ = key;
+      header.target_ = target_;
+      header.targetEntropy_ = targetEntropy_;
+      header.size_ = size_;
+      header.nGroups_ = groups.size();
+      header.nLevels_ = levels.size();
+      header.nNodes_ = nodes.size();
+      header.dictionarySize_ = dictionaryData.size();
+      header.rootCount_ = root_.count_;
+      header.rootPartCount_ = root_.part_->count_;
+
+      std::string body;
+      body.reserve(groups.size() * sizeof(GroupImage) + levels.size() * sizeof(LevelImage) + nodes.size() * sizeof(NodeImage) + dictionaryData.size());
+      body.append(reinterpret_cast<const char*>(groups.data()), groups.size() * sizeof(GroupImage));
+      body.append(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(LevelImage));
+      body.append(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(NodeImage));
+      body += dictionaryData;
+      WordHash checksum;
+      checksum.add(body.data(), body.data() + body.size());
+      header.checksum_ = checksum;
+
+      // Written aside then renamed so that concurrent runs never map partial images
+      const std::string temporary = fileName + ".tmp" + std::to_string(::getpid());
+      {
+	std::ofstream os(temporary, std::ios::out | std::ios::binary);
+	writeRecord(os, header);
+	os << body;
+	os.close();
+	if(! os) {
+	  std::filesystem::remove(temporary);
+	  throw std::runtime_error("Cannot write tree image " + fileName);
+	}
+      }
+      std::filesystem::rename(temporary, fileName);
+    }
 
-      build(begin, end);
+    bool FPTree::load(const std::string& fileName, std::uint64_t key) {
+      if(! std::filesystem::is_regular_file(fileName)) return false;
+      cool::MappedFile image(fileName);
+      if(image.size() < sizeof(ImageHeader)) return false;
+      const char* data = image.begin();
+      const ImageHeader header = readRecord<ImageHeader>(data);
+      if(std::memcmp(header.magic_, imageMagic, sizeof(imageMagic)) != 0 || header.key_ != key)
+	return false;
+
+      // Images that are truncated (e.g. disk full) or corrupted are rebuilt like missing ones: they are checked before any change of the tree
+      const std::uint64_t bodySize = image.size() - sizeof(ImageHeader);
+      if(header.nGroups_ > bodySize / sizeof(GroupImage) || header.nLevels_ > bodySize / sizeof(LevelImage)
+	 || header.nNodes_ > bodySize / sizeof(NodeImage)
+	 || bodySize != header.nGroups_ * sizeof(GroupImage) + header.nLevels_ * sizeof(LevelImage)
+	 + header.nNodes_ * sizeof(NodeImage) + header.dictionarySize_)
+	return false;
+      WordHash checksum;
+      checksum.add(data, image.end());
+      if(checksum != header.checksum_) return false;
+
+      const char* const groupData = data;
+      const char* const levelData = groupData + header.nGroups_ * sizeof(GroupImage);
+      const char* const nodeData = levelData + header.nLevels_ * sizeof(LevelImage);
+      const char* const dictionaryData = nodeData + header.nNodes_ * sizeof(NodeImage);
+
+      Dictionary dictionary;
+      if(! readDictionary(dictionaryData, image.end(), dictionary)) return false;
+      // Variables are distinct, named if the data have names, and so are the values of every variable
+      const size_t nVars = dictionary.names_.empty() ? size_t(std::numeric_limits<attribute_type>::max()) + 1 : dictionary.names_.size();
+      std::vector<bool> seen(nVars, false);
+      std::set<pair_type> values;
+      bool hasTarget = false;
+      std::uint64_t nLevels = 0;
+      for(const char *group = groupData, *level = levelData; group != levelData;) {
+	const GroupImage groupImage = readRecord<GroupImage>(group);
+	if(groupImage.var_ >= nVars || seen[groupImage.var_] || groupImage.nLevels_ > header.nLevels_ - nLevels) return false;
+	seen[groupImage.var_] = true;
+	hasTarget |= static_cast<std::int64_t>(groupImage.var_) == header.target_;
+	nLevels += groupImage.nLevels_;
+	for(std::uint32_t j = 0; j != groupImage.nLevels_; ++j)
+	  if(! values.insert({ static_cast<attribute_type>(groupImage.var_), readRecord<LevelImage>(level).value_ }).second) return false;
+      }
+      if(! hasTarget || nLevels != header.nLevels_) return false;
+      for(std::uint64_t i = 0; i != header.nNodes_; ++i) {
+	const char* node = nodeData + i * sizeof(NodeImage);
+	const NodeImage nodeImage = readRecord<NodeImage>(node);
+	if(nodeImage.parent_ > i || nodeImage.level_ >= nLevels || nodeImage.count_ > std::numeric_limits<token_type>::max()) return false;
+      }
+      if(header.rootCount_ > std::numeric_limits<token_type>::max()) return false;
+
+      std::vector<Level*> levels;
+      std::vector<count_type> partCounts;
+      levels.reserve(header.nLevels_);
+      partCounts.reserve(header.nLevels_);
+      data = groupData;
+      const char* level = levelData;
+      for(std::uint64_t i = 0; i != header.nGroups_; ++i) {
+	const GroupImage groupImage = readRecord<GroupImage>(data);
+	// Groups are created in search order, which is the order of sortedGroups_
+	Group& group = this->group(static_cast<attribute_type>(groupImage.var_));
+	group.H_ = groupImage.H_;
+	group.index_ = static_cast<long>(i);
+	for(std::uint32_t j = 0; j != groupImage.nLevels_; ++j) {
+	  const LevelImage levelImage = readRecord<LevelImage>(level);
+	  Level& newLevel = this->level({ group.var_, levelImage.value_ });
+	  newLevel.count_ = levelImage.count_;
+	  levels.push_back(&newLevel);
+	  partCounts.push_back(levelImage.partCount_);
+	}
+      }
+      for(Group* group : sortedGroups_) group->buildParts();
+      for(size_t i = 0; i != levels.size(); ++i) levels[i]->part_->count_ = partCounts[i];
+
+      data = nodeData;
+      std::vector<Node*> nodes;
+      nodes.reserve(header.nNodes_);
+      for(std::uint64_t i = 0; i != header.nNodes_; ++i) {
+	const NodeImage nodeImage = readRecord<NodeImage>(data);
+	Node* node = addNode(*levels[nodeImage.level_], nodeImage.parent_ == 0 ? &root_ : nodes[nodeImage.parent_ - 1]);
+	node->count_ = static_cast<token_type>(nodeImage.count_);
+	nodes.push_back(node);
+      }
+      root_.count_ = static_cast<token_type>(header.rootCount_);
+      root_.part_->count_ = header.rootPartCount_;
+      size_ = header.size_;
+
+      target_ = static_cast<int>(header.target_);
+      targetGroup_ = &groups_.at(static_cast<attribute_type>(target_));
+      targetEntropy_ = header.targetEntropy_;
+      for(Group* group : sortedGroups_) group->reserveMaxPartNumber();
+      dictionary_ = std::move(dictionary);
+      return true;
     }
   }
 }
@@ -28,15 +28,19 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <string>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <map>
 #include <type_traits>
 #include <boost/pool/object_pool.hpp>
 #include "gimlet/thread_pool.hpp"
+#include <gimlet/memory_budget.hpp>
 #include <gimlet/topk_queue.hpp>
 
 #include <gimlet/itemsets.hpp>
+#include <gimlet/csv_reader.hpp>
 #include <gimlet/mining/data_partition_scores.hpp>
 
 
@@ -77,7 +81,7 @@ namespace gimlet {
        */
       using count_type = unsigned long;
 
-      using pair_type = std::pair<attribute_type, attribute_value_type>;
+      using pair_type = std::pair<attribute_type, wide_attribute_value_type>;
       //    private:
       
       using pattern_type = std::vector<pair_type>;
@@ -187,7 +191,7 @@ namespace gimlet {
       };
 
       struct Group : std::vector<Level*> {
-	std::vector<Part> parts_;
+	std::vector<Part, cool::CountingAllocator<Part, cool::MemoryBudget::treeParts>> parts_;
 	attribute_type var_;
 	double H_;
 	long index_;
@@ -348,6 +352,12 @@ namespace gimlet {
 	
       };
 
+      /* Minimal number of nodes per parallel chunk of skip() */
+      static constexpr size_t minSkipChunk_ = 4096;
+      /* Number of nodes per pool block once the memory budget is nearly used */
+      static constexpr size_t minPoolBlock_ = 1024;
+      using node_pool_t = boost::object_pool<Node, cool::CountingUserAllocator<cool::MemoryBudget::treeNodes>>;
+
       void skip(Group&);
       static double hyperGeometricProbLog(count_type k, count_type a, count_type b, count_type n);
       double computeInfoBias(const Group& currentGroup) const;
@@ -357,7 +367,7 @@ namespace gimlet {
       std::map<attribute_type, Group> groups_;
       std::vector<Group*> sortedGroups_;
       
-      std::unique_ptr<boost::object_pool<Node>> pool_;
+      std::unique_ptr<node_pool_t> pool_;
       size_t size_, nbrNodes_;
       Node root_;
       Level rootLevel_;
@@ -365,10 +375,12 @@ namespace gimlet {
       double targetEntropy_;
       Group* targetGroup_;
       int target_;
+      Dictionary dictionary_;
       
       Group& group(attribute_type attr);
       Level& level(const pair_type& attr);
       Node* addNode(const pair_type& attr, Node* parent);
+      Node* addNode(Level& level, Node* parent);
 
       template<typename Processor, typename Scorer>
       class PatternGenerator;
@@ -387,24 +399,60 @@ namespace gimlet {
 	return maxAttr;
       }
 
-      void build(std::vector<pattern_type>& data);
+      /*
+       * Rows read before building the tree, values being stored with the narrowest
+       * type holding them (see store_with_narrowest_values)
+       */
+      template<typename Value>
+      struct Rows : std::vector<valued_row_type<Value>> {
+	Rows() = default;
+	template<typename Narrower>
+	Rows(Rows<Narrower>&& other) {
+	  this->reserve(other.size());
+	  for(const auto& row : other) this->emplace_back(row.begin(), row.end());
+	  other.clear();
+	}
+
+	template<typename Row>
+	void push(const Row& row) { this->emplace_back(row.begin(), row.end()); }
+      };
+
+      template<typename Value>
+      void build(std::vector<valued_row_type<Value>>& data);
 
     public:
-      FPTree(int target, size_t nThreads);
+      FPTree(int target, size_t nThreads, bool pinned = false);
       FPTree(const FPTree&) = delete;
       FPTree(FPTree&&) = default;
 
       template<typename DataIterator>
       void build(DataIterator begin, DataIterator end) {
-	std::vector<pattern_type> data;
-	for(auto it = begin; it != end; ++it) data.push_back(*it);
-	build(data);
+	store_with_narrowest_values<Rows>(begin, end, [this](auto& rows) { build(rows); });
       }
       
+      /* Builds the tree from JSON or CSV data (see read_rows) */
       void build(std::istream&);
+      /* Builds the tree from a file (standard input if empty), from its image if one was saved */
+      void build(const std::string& fileName);
+
+      /*
+       * Directory of the images of trees reused by later runs on the same data
+       * and target (none if empty). An image is the flat list of the groups and
+       * levels in search order, then of the nodes, parents first: it is mapped
+       * and linked in a single pass, without parsing nor sorting any data.
+       */
+      static std::string& imageDirectory();
+      /* Writes the image of the tree, key identifying its data and target */
+      void save(const std::string& fileName, std::uint64_t key) const;
+      /* Rebuilds the empty tree from an image saved with key (false if there is none) */
+      bool load(const std::string& fileName, std::uint64_t key);
+      /* Names of the attributes and of their values (empty unless the data were CSV) */
+      const Dictionary& dictionary() const;
       size_t size() const;
       size_t nbrNodes() const;
       size_t nVars() const;
+      /* Smallest number of values of the non constant attributes, the target excepted (2 if none) */
+      size_t minValues() const;
       double targetEntropy() const;
       void internalState(std::ostream& os);
 
@@ -433,6 +481,8 @@ namespace gimlet {
      */
     template<typename Processor, typename Scorer=NoScore<FPTree::Group>>
     class FPTree::PatternGenerator {
+      using score_t = typename Scorer::value_t;
+      
       FPTree& tree_;
       Processor& processor_;
       Scorer scorer_;
@@ -457,8 +507,8 @@ namespace gimlet {
 	  std::cerr << "SCORE " <<  itemset(processor_.pattern()) << std::endl;
 #endif	  
 	  Scorer newScorer = previousScorer(group);
-	  double score, bound;
-	  std::tie(score, bound) = static_cast<std::pair<double,double>>(newScorer);
+	  score_t score, bound;
+	  std::tie(score, bound) = static_cast<std::pair<score_t, score_t>>(newScorer);
 	  processor_.emit(score);
 #ifdef DEBUG_COUNTS
 	  std::cerr << std::setprecision(3) << "RESULT " << score << " " << bound;
@@ -486,11 +536,12 @@ namespace gimlet {
       }
       void generate() {
 	scorer_.setTarget(*targetGroup_);
+	scorer_.setMinValues(tree_.minValues());
 	Group& rootGroup = tree_.rootGroup_;
 
 	Scorer newScorer = scorer_(rootGroup);
-	double score, bound;
-	std::tie(score, bound) = static_cast<std::pair<double,double>>(newScorer);
+	score_t score, bound;
+	std::tie(score, bound) = static_cast<std::pair<score_t, score_t>>(newScorer);
 	
 	processor_.emit(score);
 	if(processor_.toDevelop(bound))
@@ -29,11 +29,14 @@
 #include <fstream>
 #include <limits>
 #include <algorithm>
+#include <type_traits>
 
 #include "gimlet/timer.hpp"
 #include "gimlet/statistics.hpp"
 
-#include <gimlet/json_parser.hpp>
+#include <gimlet/encoded_parser.hpp>
+#include <gimlet/concurrent_topk.hpp>
+#include <gimlet/mining/topk_snapshots.hpp>
 #include <gimlet/data_iterator.hpp>
 
 #include "FPTree.hpp"
@@ -50,40 +53,55 @@ namespace gimlet {
       struct Stats : cool::Statistics {
 	unsigned int target_;
 	unsigned int nPatterns_;
+	unsigned int nPruned_;
 	double totalTime_;
 
-	Stats() : Statistics() {
+	Stats() : Statistics(), nPatterns_(0), nPruned_(0) {
 	  addInteger("target", target_);
 	  addDouble("total time", totalTime_, "s");
 	  addInteger("patterns", nPatterns_);
+	  addInteger("pruned branches", nPruned_);
+	  cool::MemoryBudget::instance().addStatistics(*this, cool::MemoryBudget::treeNodes);
+	  cool::MemoryBudget::instance().addStatistics(*this, cool::MemoryBudget::treeParts);
 	}
       };
       
       Stats stats_;
       
+      /* Snapshots: heaps locked for the snapshots taken while the tree is mined (see TopKSnapshots) */
+      template<bool Snapshots>
       class PatternProcessor {
-	using pattern_type = std::vector<attribute_type>;
-	using output_format = tuple<list<attribute_type>, double>;
-	using parser_t = JSONParser<flow<output_format>>;
+	using pattern_type = pattern_varset_type;
+	using output_format = tuple<list<named<attribute_type>>, double>;
+	using parser_t = EncodedParser<flow<output_format>>;
 	using stream_t = output_stream_t<parser_t>;
 
+	struct ScoreComparator {
+	  bool operator()(const score_t& s1, const score_t& s2) const { return scorer_t::comparator(s1, s2); }
+	};
+
 	struct Entry : std::pair<pattern_type, score_t> {
 	  void setScore(const score_t& score) { this->second = score; }
 	  pattern_type& fields() { return this->first; }
 	  const pattern_type& fields() const { return this->first; }
 	  const score_t& score() const { return this->second; }
-	  bool operator<(const Entry& other) const { return scorer_t::comparator(this->score(), other.score()); }
+	  /* Ties are broken by patterns so that the top-k does not depend on the search order */
+	  bool operator<(const Entry& other) const {
+	    if(scorer_t::comparator(this->score(), other.score())) return true;
+	    if(scorer_t::comparator(other.score(), this->score())) return false;
+	    return other.fields() < this->fields();
+	  }
 	};
 	
 	stream_t outputDataStream_;
 	output_stream_iterator_t<stream_t> outputIt_;
 	Entry pattern_;      
 	Stats& stats_;	
-	cool::topk_queue<Entry> queue_;      
+	cool::concurrent_topk<Entry, ScoreComparator, Snapshots> queue_;      
 
 	struct SortQueuePattern {
 	  Entry operator()(Entry entry) {
-	    varset_type& pattern = entry.first;
+	    pattern_type& pattern = entry.first;
 	    std::sort(pattern.begin(), pattern.end());
 	    return entry;
 	  }
@@ -94,16 +112,84 @@ namespace gimlet {
 	~PatternProcessor();
 
 	bool toDevelop(score_t bound) {
-	  return ((!queue_.full()) || scorer_t::comparator(queue_.last().score(), bound));
+	  if(queue_.accepts(bound))
+	    return true;
+	  ++stats_.nPruned_;
+	  return false;
 	}
 	
 	void emit(score_t score);
 	void push(attribute_type var);
 	void pop();
 
+	/* Takes snapshots of the top-k while the tree is mined (see TopKSnapshots) */
+	void startSnapshots(const std::vector<std::string>& names);
+
+	const pattern_type& pattern() const { return pattern_.fields(); }
+      };   
+
+      /*
+       * Processor for scorers returning one score per lane (see CompositeScore):
+       * every lane has its own top-k queue and a pattern is developed as long as
+       * its bound can improve at least one of them.
+       * Output is a list of top-k lists, one per lane.
+       */
+      class MultiPatternProcessor {
+	using pattern_type = pattern_varset_type;
+	using output_format = list<tuple<list<named<attribute_type>>, double>>;
+	using parser_t = EncodedParser<flow<output_format>>;
+	using stream_t = output_stream_t<parser_t>;
+
+	struct Entry : std::pair<pattern_type, double> {
+	  void setScore(double score) { this->second = score; }
+	  pattern_type& fields() { return this->first; }
+	  const pattern_type& fields() const { return this->first; }
+	  double score() const { return this->second; }
+	  /* Ties are broken as by PatternProcessor, so that every lane is the top-k of the dedicated search */
+	  bool operator<(const Entry& other) const {
+	    if(scorer_t::comparator(this->score(), other.score())) return true;
+	    if(scorer_t::comparator(other.score(), this->score())) return false;
+	    return other.fields() < this->fields();
+	  }
+	};
+	
+	stream_t outputDataStream_;
+	output_stream_iterator_t<stream_t> outputIt_;
+	Entry pattern_;      
+	Stats& stats_;	
+	std::vector<cool::topk_queue<Entry>> queues_;      
+
+	struct SortQueuePattern {
+	  Entry operator()(Entry entry) {
+	    pattern_type& pattern = entry.first;
+	    std::sort(pattern.begin(), pattern.end());
+	    return entry;
+	  }
+	};
+	
+      public:
+	MultiPatternProcessor(size_t K, size_t nLanes, std::ostream& outputStream, Stats& stats);
+	~MultiPatternProcessor();
+
+	bool toDevelop(const score_t& bounds) {
+	  for(size_t lane = 0; lane != queues_.size(); ++lane) {
+	    const cool::topk_queue<Entry>& queue = queues_[lane];
+	    if((!queue.full()) || scorer_t::comparator(queue.last().score(), bounds[lane]))
+	      return true;
+	  }
+	  ++stats_.nPruned_;
+	  return false;
+	}
+	
+	void emit(const score_t& scores);
+	void push(attribute_type var);
+	void pop();
+
 	const pattern_type& pattern() const { return pattern_.fields(); }
       };   
 
+      static constexpr bool multiLane = ! std::is_arithmetic_v<score_t>;
+
     public:
       
       void operator()(
@@ -111,6 +197,7 @@ namespace gimlet {
 		      int target,
 		      size_t K,
 		      size_t nThreads,
+		      bool affinity,
 		      const std::string& inputFileName,
 		      const std::string& outputFileName,
 		      const std::string& statsFileName);
@@ -119,7 +206,8 @@ namespace gimlet {
     };
 
     template<typename Scorer>
-    IFPGrowth<Scorer>::PatternProcessor::PatternProcessor(size_t K, std::ostream& outputStream, Stats& stats) :
+    template<bool Snapshots>
+    IFPGrowth<Scorer>::PatternProcessor<Snapshots>::PatternProcessor(size_t K, std::ostream& outputStream, Stats& stats) :
       outputDataStream_{outputStream, parser_t{}},	
       outputIt_{outputDataStream_},
       pattern_(),
@@ -128,24 +216,76 @@ namespace gimlet {
       }
     
     template<typename Scorer>
-    IFPGrowth<Scorer>::PatternProcessor::~PatternProcessor() {
+    template<bool Snapshots>
+    IFPGrowth<Scorer>::PatternProcessor<Snapshots>::~PatternProcessor() {
+      if constexpr(Snapshots) TopKSnapshots::instance().stop();
       queue_.purge(outputIt_, SortQueuePattern{});
     }
 
     template<typename Scorer>
-    void IFPGrowth<Scorer>::PatternProcessor::emit(score_t score) {
+    template<bool Snapshots>
+    void IFPGrowth<Scorer>::PatternProcessor<Snapshots>::startSnapshots(const std::vector<std::string>& names) {
+      TopKSnapshots::instance().start([this, &names] () {
+	  std::vector<std::tuple<std::vector<attribute_type>, double>> entries;
+	  queue_.snapshot(std::back_inserter(entries), SortQueuePattern{});
+	  return TopKSnapshots::format<list<output_format>>(entries, names);
+	});
+    }
+
+    template<typename Scorer>
+    template<bool Snapshots>
+    void IFPGrowth<Scorer>::PatternProcessor<Snapshots>::emit(score_t score) {
 	pattern_.setScore(score);
 	queue_.push(pattern_);      
 	++stats_.nPatterns_;
     }
 
     template<typename Scorer>
-    void IFPGrowth<Scorer>::PatternProcessor::push(attribute_type var) {
+    template<bool Snapshots>
+    void IFPGrowth<Scorer>::PatternProcessor<Snapshots>::push(attribute_type var) {
+      pattern_.fields().push_back(var);
+    }
+
+    template<typename Scorer>
+    template<bool Snapshots>
+    void IFPGrowth<Scorer>::PatternProcessor<Snapshots>::pop() {
+      pattern_.fields().pop_back();
+    }
+
+    template<typename Scorer>
+    IFPGrowth<Scorer>::MultiPatternProcessor::MultiPatternProcessor(size_t K, size_t nLanes, std::ostream& outputStream, Stats& stats) :
+      outputDataStream_{outputStream, parser_t{}},	
+      outputIt_{outputDataStream_},
+      pattern_(),
+      stats_(stats),
+      queues_(nLanes, cool::topk_queue<Entry>(K)) {
+      }
+    
+    template<typename Scorer>
+    IFPGrowth<Scorer>::MultiPatternProcessor::~MultiPatternProcessor() {
+      for(cool::topk_queue<Entry>& queue : queues_) {
+	std::vector<std::tuple<std::vector<attribute_type>, double>> entries;
+	queue.purge(std::back_inserter(entries), SortQueuePattern{});
+	*outputIt_++ = entries;
+      }
+    }
+
+    template<typename Scorer>
+    void IFPGrowth<Scorer>::MultiPatternProcessor::emit(const score_t& scores) {
+      for(size_t lane = 0; lane != queues_.size(); ++lane) {
+	pattern_.setScore(scores[lane]);
+	queues_[lane].push(pattern_);
+      }
+      ++stats_.nPatterns_;
+    }
+
+    template<typename Scorer>
+    void IFPGrowth<Scorer>::MultiPatternProcessor::push(attribute_type var) {
       pattern_.fields().push_back(var);
     }
 
     template<typename Scorer>
-    void IFPGrowth<Scorer>::PatternProcessor::pop() {
+    void IFPGrowth<Scorer>::MultiPatternProcessor::pop() {
       pattern_.fields().pop_back();
     }
 
@@ -158,16 +298,11 @@ namespace gimlet {
 			       int target,
 			       size_t K,
 			       size_t nThreads,
+			       bool affinity,
 			       const std::string& inputFileName,
 			       const std::string& outputFileName,
 			       const std::string& statsFileName
 			       ) {
-      auto inputStream = std::ref(std::cin);
-      std::ifstream inputFile;
-      if(! inputFileName.empty()) {
-	inputFile.open(inputFileName, std::ios::in | std::ios::binary);
-	inputStream = inputFile;
-      }
       auto outputStream = std::ref(std::cout);
       std::ofstream outputFile;
       if(! outputFileName.empty()) {
@@ -181,14 +316,26 @@ namespace gimlet {
       cool::Timer timer;
       timer.start();
 
-      FPTree tree{target, nThreads};
-      tree.build(inputStream);
+      FPTree tree{target, nThreads, affinity};
+      tree.build(inputFileName);
       
       //tree.internalState(std::clog);
       
-      PatternProcessor processor{K, outputStream, stats_};	
-	
-      tree.generate(processor, scorer);
+      // Attributes are written by name when the data have some (CSV header)
+      if(! tree.dictionary().empty()) set_names(outputStream, &tree.dictionary().names_);
+      if constexpr(multiLane) {
+	MultiPatternProcessor processor{K, scorer.lanes(), outputStream, stats_};
+	tree.generate(processor, scorer);
+      } else if(TopKSnapshots::instance().enabled()) {
+	// The heaps are locked only if snapshots read them during the search
+	PatternProcessor<true> processor{K, outputStream, stats_};
+	processor.startSnapshots(tree.dictionary().names_);
+	tree.generate(processor, scorer);
+      } else {
+	PatternProcessor<false> processor{K, outputStream, stats_};
+	tree.generate(processor, scorer);
+      }
+      set_names(outputStream, nullptr);
       
       stats_.totalTime_ = timer.stop();
       stats_.write();
@@ -40,15 +40,16 @@ namespace gimlet {
       scorer_type scorer_;
       miner_type miner_;
     public:
-      AdjustedInfoTopK(double alpha) : scorer_(alpha), miner_() {}
+      AdjustedInfoTopK(double alpha, bool tightBound) : scorer_(alpha, tightBound), miner_() {}
   
       void operator()(int target,
 		      size_t K,
 		      size_t nThreads,
+		      bool affinity,
 		      const std::string& inputFileName,
 		      const std::string& outputFileName,
 		      const std::string& statsFileName) {
-	miner_(scorer_, target, K, nThreads, inputFileName, outputFileName, statsFileName);
+	miner_(scorer_, target, K, nThreads, affinity, inputFileName, outputFileName, statsFileName);
       }
     };
   }
@@ -58,11 +59,15 @@ int main(int argc, char *argv[]) {
   using namespace gimlet::itemsets;
   try {
     
-    std::string inputFileName, outputFileName, statsFileName;
+    std::string inputFileName, outputFileName, outputFormat, statsFileName, memoryLimit, snapshotFileName, treeCache;
+    double snapshotInterval;
+    bool hugePages;
     int target;
     size_t K;
     double alpha;
+    bool looseBound;
     size_t nThreads = std::thread::hardware_concurrency();
+    bool affinity;
     
     {
       namespace po = boost::program_options;
@@ -72,9 +77,17 @@ int main(int argc, char *argv[]) {
 	("target", po::value<int>(&target)->required(), "target attribute (negative target starts from the end: -1 is the last attribute)")
 	("K", po::value<size_t>(&K)->default_value(1), "number K of top-k patterns")
 	("alpha", po::value<double>(&alpha)->default_value(0.95), "Probability value for Chi2 statistical test")
+	("loose-bound", po::bool_switch(&looseBound), "use the former bound 1 - bias (to compare pruning efficiency)")
 	("threads", po::value<size_t>(&nThreads), "number of threads")
+	("affinity", po::bool_switch(&affinity), "pin threads to cores")
+	("memory-limit", po::value<std::string>(&memoryLimit), "soft memory limit (e.g. 512M or 4G) the miner tries to stay below")
+	("huge-pages", po::bool_switch(&hugePages), "back large FP-tree node blocks by huge pages")
 	("input", po::value<std::string>(&inputFileName), "input filename")
 	("output", po::value<std::string>(&outputFileName), "output filename")
+	("output-format", po::value<std::string>(&outputFormat)->default_value("json"), "format of the output: json, bin (compact binary, see bin_parser.hpp) or cbor")
+	("snapshots", po::value<std::string>(&snapshotFileName), "file receiving NDJSON snapshots of the current top-k while the search runs")
+	("snapshot-interval", po::value<double>(&snapshotInterval)->default_value(1.), "minimal interval in seconds between two snapshots")
+	("tree-cache", po::value<std::string>(&treeCache), "directory of FP-tree images reused by later runs on the same input and target")
 	("stats", po::value<std::string>(&statsFileName), "statistics filename");
 
       po::variables_map vm;
@@ -84,9 +97,16 @@ int main(int argc, char *argv[]) {
 	return EXIT_FAILURE;
       }
       po::notify(vm);
+      if(! memoryLimit.empty())
+	cool::MemoryBudget::instance().setLimit(cool::parseMemorySize(memoryLimit));
+      cool::HugePageArena::instance().enable(hugePages);
+      gimlet::output_encoding() = gimlet::parse_encoding(outputFormat);
+      if(! snapshotFileName.empty())
+	TopKSnapshots::instance().open(snapshotFileName, snapshotInterval);
+      FPTree::imageDirectory() = treeCache;
     }
-    AdjustedInfoTopK topKminer{1-alpha};
-    topKminer(target, K, nThreads, inputFileName, outputFileName, statsFileName);
+    AdjustedInfoTopK topKminer{1-alpha, ! looseBound};
+    topKminer(target, K, nThreads, affinity, inputFileName, outputFileName, statsFileName);
     return EXIT_SUCCESS;
   } catch(const std::exception& ex) {
     std::cerr << "Error: " << ex.what() << std::endl;
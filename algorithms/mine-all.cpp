@@ -0,0 +1,123 @@
+/*
+ *   Copyright (C) 2018,  CentraleSupelec
+ *
+ *   Author : Frédéric Pennerath
+ *
+ *   Contributor :
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public
+ *   License (GPL) as published by the Free Software Foundation; either
+ *   version 3 of the License, or any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *   Contact : frederic.pennerath@centralesupelec.fr
+ *
+ */
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <thread>
+
+#include <gimlet/mining/data_partition_scores.hpp>
+
+#include "IFPGrowth.hpp"
+
+namespace gimlet {
+  namespace itemsets {
+
+    /*
+     * Mines the top-k patterns of SMI, RFI, AFI and MFI with a single tree traversal.
+     * Output is the list of the four top-k lists in that order.
+     */
+    class AllScoresTopK {
+      using scorer_type = CompositeScore<partition_tree_parition_t,
+					 SmoothedInformation<partition_tree_parition_t, false, true>,
+					 ReliableFractionOfInformation<partition_tree_parition_t>,
+					 AdjustedDependency<partition_tree_parition_t>,
+					 SuzukiInfo<partition_tree_parition_t>>;
+      using miner_type = IFPGrowth<scorer_type>;
+      scorer_type scorer_;
+      miner_type miner_;
+    public:
+      AllScoresTopK(double smiAlpha, double afiAlpha) :
+	scorer_({ smiAlpha }, {}, { afiAlpha }, {}), miner_() {}
+  
+      void operator()(int target,
+		      size_t K,
+		      size_t nThreads,
+		      bool affinity,
+		      const std::string& inputFileName,
+		      const std::string& outputFileName,
+		      const std::string& statsFileName) {
+	miner_(scorer_, target, K, nThreads, affinity, inputFileName, outputFileName, statsFileName);
+      }
+    };
+  }
+}
+  
+int main(int argc, char *argv[]) {
+  using namespace gimlet::itemsets;
+  try {
+    
+    std::string inputFileName, outputFileName, outputFormat, statsFileName, memoryLimit, snapshotFileName, treeCache;
+    double snapshotInterval;
+    bool hugePages;
+    int target;
+    size_t K;
+    double smiAlpha, afiAlpha;
+    size_t nThreads = std::thread::hardware_concurrency();
+    bool affinity;
+    
+    {
+      namespace po = boost::program_options;
+      po::options_description desc("Allowed options");
+      desc.add_options()
+	("help", "help message")
+	("target", po::value<int>(&target)->required(), "target attribute (negative target starts from the end: -1 is the last attribute)")
+	("K", po::value<size_t>(&K)->default_value(1), "number K of top-k patterns for every score")
+	("smi-alpha", po::value<double>(&smiAlpha)->default_value(1.), "Laplace smoothing coefficient of SMI")
+	("afi-alpha", po::value<double>(&afiAlpha)->default_value(0.95), "Probability value for Chi2 statistical test of AFI")
+	("threads", po::value<size_t>(&nThreads), "number of threads")
+	("affinity", po::bool_switch(&affinity), "pin threads to cores")
+	("memory-limit", po::value<std::string>(&memoryLimit), "soft memory limit (e.g. 512M or 4G) the miner tries to stay below")
+	("huge-pages", po::bool_switch(&hugePages), "back large FP-tree node blocks by huge pages")
+	("input", po::value<std::string>(&inputFileName), "input filename")
+	("output", po::value<std::string>(&outputFileName), "output filename")
+	("output-format", po::value<std::string>(&outputFormat)->default_value("json"), "format of the output: json, bin (compact binary, see bin_parser.hpp) or cbor")
+	("snapshots", po::value<std::string>(&snapshotFileName), "file receiving NDJSON snapshots of the current top-k while the search runs")
+	("snapshot-interval", po::value<double>(&snapshotInterval)->default_value(1.), "minimal interval in seconds between two snapshots")
+	("tree-cache", po::value<std::string>(&treeCache), "directory of FP-tree images reused by later runs on the same input and target")
+	("stats", po::value<std::string>(&statsFileName), "statistics filename");
+
+      po::variables_map vm;
+      po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+      if(argc == 1 || vm.count("help")) {
+	std::cout << desc << "\n";
+	return EXIT_FAILURE;
+      }
+      po::notify(vm);
+      if(! memoryLimit.empty())
+	cool::MemoryBudget::instance().setLimit(cool::parseMemorySize(memoryLimit));
+      cool::HugePageArena::instance().enable(hugePages);
+      gimlet::output_encoding() = gimlet::parse_encoding(outputFormat);
+      if(! snapshotFileName.empty())
+	TopKSnapshots::instance().open(snapshotFileName, snapshotInterval);
+      FPTree::imageDirectory() = treeCache;
+    }
+    AllScoresTopK topKminer{smiAlpha, 1-afiAlpha};
+    topKminer(target, K, nThreads, affinity, inputFileName, outputFileName, statsFileName);
+    return EXIT_SUCCESS;
+  } catch(const std::exception& ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -2,11 +2,14 @@
 #include <boost/program_options.hpp>
 #include <iostream>
 #include <iomanip>
+#include <thread>
 
 #include <gimlet/mining/search_algorithms.hpp>
 #include <gimlet/mining/data_processors.hpp>
 #include <gimlet/mining/scoring_functions.hpp>
 #include <gimlet/mining/data_partition.hpp>
+#include <gimlet/mining/resampling.hpp>
+#include <gimlet/mining/sampling.hpp>
 
 #if defined(BOUND1) && (BOUND1 == 0)
 #define BOOL_BOUND1 false
@@ -25,7 +28,7 @@ namespace gimlet {
   namespace itemsets {
 
     template<typename Scorer>
-    void mine_exactly(Scorer& scorer, std::string inputFileName, std::string outputFileName, std::string statsFileName, bool opus, double rho, int target) {
+    void mine_exactly(Scorer& scorer, std::string inputFileName, std::string outputFileName, std::string statsFileName, bool opus, bool removeRedundant, double rho, int target, std::string columnStore, size_t nResidentColumns, size_t nThreads) {
       using scorer_t = Scorer;
       using processor_t = RhoProcessor<scorer_t, Partitions>;
       using miner_t = BranchAndBoundMiner<Partitions, processor_t>;
@@ -38,6 +41,9 @@ namespace gimlet {
       }
       
       processor_t processor{rho, target, outputStream, scorer};
+      processor.setRedundantColumnRemoval(removeRedundant);
+      processor.setColumnStore(columnStore, nResidentColumns);
+      processor.setLoadThreads(nThreads);
       miner_t miner{inputFileName, processor, opus};
       if(! statsFileName.empty()) processor.statistics().open(statsFileName);
 
@@ -45,8 +51,32 @@ namespace gimlet {
       //   scorer.displayRatio();
     }
 
+    template<typename Scorer, typename ReplicateScorer>
+    void mine_sample(Scorer& scorer, const ReplicateScorer& replicateScorer, std::string inputFileName, std::string outputFileName, std::string statsFileName, bool opus, bool removeRedundant, double rho, int target,
+		     double sampleRate, bool stratified, double sampleRho, double confidence, unsigned long seed, std::string columnStore, size_t nResidentColumns, size_t nThreads) {
+      using scorer_t = Scorer;
+      using processor_t = SampledRhoProcessor<scorer_t, Partitions, ReplicateScorer>;
+      using miner_t = BranchAndBoundMiner<Partitions, processor_t>;
+
+      auto outputStream = std::ref(std::cout);
+      std::ofstream outputFile;
+      if(! outputFileName.empty()) {
+	outputFile.open(outputFileName, std::ios::out | std::ios::binary);
+	outputStream = outputFile;
+      }
+      
+      processor_t processor{rho, sampleRho, target, sampleRate, stratified, confidence, seed, inputFileName, outputStream, scorer, replicateScorer};
+      processor.setRedundantColumnRemoval(removeRedundant);
+      processor.setColumnStore(columnStore, nResidentColumns);
+      processor.setLoadThreads(nThreads);
+      miner_t miner{inputFileName, processor, opus};
+      if(! statsFileName.empty()) processor.statistics().open(statsFileName);
+
+      miner.mine();
+    }
+
     template<typename Scorer>
-    void mine_approximatively(Scorer& scorer, std::string inputFileName, std::string outputFileName, std::string statsFileName, bool rsd, bool opus, double rho, int target) {
+    void mine_approximatively(Scorer& scorer, std::string inputFileName, std::string outputFileName, std::string statsFileName, bool rsd, bool opus, bool removeRedundant, double rho, int target, std::string columnStore, size_t nResidentColumns, size_t nThreads) {
       using scorer_t = Scorer;
       using processor_t = RhoProcessor<scorer_t, Partitions>;
       using miner_t = BranchTopMiner<Partitions, processor_t>;
@@ -59,6 +89,9 @@ namespace gimlet {
       }
       
       processor_t processor{rho, target, outputStream, scorer};
+      processor.setRedundantColumnRemoval(removeRedundant);
+      processor.setColumnStore(columnStore, nResidentColumns);
+      processor.setLoadThreads(nThreads);
       miner_t miner{inputFileName, processor, rsd, opus};
       if(! statsFileName.empty()) processor.statistics().open(statsFileName);
 
@@ -72,9 +105,15 @@ int main(int argc, char *argv[]) {
   using namespace gimlet;
   using namespace gimlet::itemsets;
   try {
-    std::string inputFileName, outputFileName, statsFileName;
-    double rho; bool rsd, opus;
+    std::string inputFileName, outputFileName, outputFormat, statsFileName, memoryLimit, columnStore;
+    size_t nResidentColumns;
+    bool hugePages;
+    double rho; bool rsd, opus, removeRedundant;
+    double sampleRate, sampleRho, confidence;
+    bool stratified;
+    unsigned long seed;
     int target;
+    size_t nThreads = std::thread::hardware_concurrency();
     {
       namespace po = boost::program_options;
       po::options_description desc("Allowed options");
@@ -87,8 +126,20 @@ int main(int argc, char *argv[]) {
 	("rsd", po::bool_switch(&rsd)->default_value(false), "reject score decrease")
 	("opus", po::bool_switch(&opus)->default_value(false), "opus optimization")
 	("btop", "branch top pruning")
+	("remove-redundant", po::bool_switch(&removeRedundant), "exclude constant columns and columns equivalent to previous ones from the search, with --rfi only (patterns with such columns are still output)")
+	("sample", po::value<double>(&sampleRate), "mine a sample of this fraction of the rows, then rescore the candidates on the whole input")
+	("stratified", po::bool_switch(&stratified), "stratify the sample on the target")
+	("sample-rho", po::value<double>(&sampleRho), "relaxed rho coefficient selecting the candidates of a sampled search (rho by default)")
+	("confidence", po::value<double>(&confidence)->default_value(0.95), "confidence level of the bounds of sampled searches")
+	("seed", po::value<unsigned long>(&seed)->default_value(0), "seed of the sample")
+	("threads", po::value<size_t>(&nThreads), "number of threads loading the input")
+	("memory-limit", po::value<std::string>(&memoryLimit), "soft memory limit (e.g. 512M or 4G) the miner tries to stay below")
+	("column-store", po::value<std::string>(&columnStore), "keep columns out of core in a temporary file of this directory")
+	("resident-columns", po::value<size_t>(&nResidentColumns)->default_value(16), "maximal number of columns held in memory with --column-store")
+	("huge-pages", po::bool_switch(&hugePages), "back large partitions by huge pages")
 	("input", po::value<std::string>(&inputFileName), "input filename")
 	("output", po::value<std::string>(&outputFileName), "output filename")
+	("output-format", po::value<std::string>(&outputFormat)->default_value("json"), "format of the output: json, bin (compact binary, see bin_parser.hpp) or cbor")
 	("stats", po::value<std::string>(&statsFileName), "statistics filename");
       po::positional_options_description extraOptions;
       extraOptions.add("command", 1);
@@ -96,6 +147,15 @@ int main(int argc, char *argv[]) {
       po::variables_map vm;
       po::store(po::command_line_parser(argc, argv).options(desc).positional(extraOptions).run(), vm);
       po::notify(vm);
+      if(! memoryLimit.empty())
+	cool::MemoryBudget::instance().setLimit(cool::parseMemorySize(memoryLimit));
+      cool::HugePageArena::instance().enable(hugePages);
+      gimlet::output_encoding() = gimlet::parse_encoding(outputFormat);
+      if(! vm.count("sample-rho")) sampleRho = rho;
+      if(vm.count("sample")) {
+	if(sampleRate <= 0. || sampleRate > 1.) throw std::invalid_argument("Sampling rate must be in ]0;1]");
+	if(vm.count("btop")) throw std::invalid_argument("Sampled searches do not support branch top pruning");
+      }
       
       if(argc == 1 || vm.count("help")) {
 	std::cout << desc << "\n";
@@ -105,18 +165,22 @@ int main(int argc, char *argv[]) {
       if(vm.count("rfi")) {
 	using scorer_t = ReliableFractionOfInformation<Partition>;
 	scorer_t scorer{};
-	if(vm.count("btop"))
-	  mine_approximatively(scorer, inputFileName, outputFileName, statsFileName, rsd, opus, rho,  target);
+	if(vm.count("sample"))
+	  mine_sample(scorer, ReliableFractionOfInformation<LabelPartition>{}, inputFileName, outputFileName, statsFileName, opus, removeRedundant, rho, target, sampleRate, stratified, sampleRho, confidence, seed, columnStore, nResidentColumns, nThreads);
+	else if(vm.count("btop"))
+	  mine_approximatively(scorer, inputFileName, outputFileName, statsFileName, rsd, opus, removeRedundant, rho,  target, columnStore, nResidentColumns, nThreads);
 	else
-	  mine_exactly(scorer, inputFileName, outputFileName, statsFileName, opus, rho,  target);	
+	  mine_exactly(scorer, inputFileName, outputFileName, statsFileName, opus, removeRedundant, rho,  target, columnStore, nResidentColumns, nThreads);	
       } else if(vm.count("smi")) {
 	using scorer_t = SmoothedInformation<Partition, BOOL_BOUND1, BOOL_BOUND2>;
 	double alpha = vm["smi"].as<double>();
 	scorer_t scorer{alpha};
-	if(vm.count("btop"))
-	  mine_approximatively(scorer, inputFileName, outputFileName, statsFileName, rsd, opus, rho,  target);
+	if(vm.count("sample"))
+	  mine_sample(scorer, SmoothedInformation<LabelPartition, BOOL_BOUND1, BOOL_BOUND2>{alpha}, inputFileName, outputFileName, statsFileName, opus, removeRedundant, rho, target, sampleRate, stratified, sampleRho, confidence, seed, columnStore, nResidentColumns, nThreads);
+	else if(vm.count("btop"))
+	  mine_approximatively(scorer, inputFileName, outputFileName, statsFileName, rsd, opus, removeRedundant, rho,  target, columnStore, nResidentColumns, nThreads);
 	else
-	  mine_exactly(scorer, inputFileName, outputFileName, statsFileName, opus, rho,  target);
+	  mine_exactly(scorer, inputFileName, outputFileName, statsFileName, opus, removeRedundant, rho,  target, columnStore, nResidentColumns, nThreads);
       } else
 	throw std::invalid_argument("No scoring function provided among { rfi, smi }");
       }
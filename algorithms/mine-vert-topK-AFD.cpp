@@ -1,11 +1,14 @@
 #include <boost/program_options.hpp>
 #include <iostream>
 #include <iomanip>
+#include <thread>
 
 #include <gimlet/mining/search_algorithms.hpp>
 #include <gimlet/mining/data_processors.hpp>
 #include <gimlet/mining/scoring_functions.hpp>
 #include <gimlet/mining/data_partition.hpp>
+#include <gimlet/mining/resampling.hpp>
+#include <gimlet/mining/sampling.hpp>
 
 #if defined(BOUND1) && (BOUND1 == 0)
 #define BOOL_BOUND1 false
@@ -23,11 +26,25 @@
 namespace gimlet {
   namespace itemsets {
 
-    template<typename Scorer>
-    void mine(Scorer& scorer, std::string inputFileName, std::string outputFileName, std::string statsFileName, bool opus, size_t K, int target) {
+    template<typename Processor>
+    void mine(Processor& processor, std::string inputFileName, std::string statsFileName, bool opus, bool removeRedundant, std::string columnStore, size_t nResidentColumns, size_t nThreads) {
+      using miner_t = BranchAndBoundMiner<Partitions, Processor>;
+
+      processor.setRedundantColumnRemoval(removeRedundant);
+      processor.setColumnStore(columnStore, nResidentColumns);
+      processor.setLoadThreads(nThreads);
+      miner_t miner{inputFileName, processor, opus};
+      if(! statsFileName.empty()) processor.statistics().open(statsFileName);
+
+      miner.mine();
+      //   scorer.displayRatio();
+    }
+
+    template<typename Scorer, typename ReplicateScorer>
+    void mine(Scorer& scorer, const ReplicateScorer& replicateScorer, std::string inputFileName, std::string outputFileName, std::string statsFileName, bool opus, bool removeRedundant, size_t K, int target,
+	      size_t nPermutations, size_t nBootstraps, double confidence, unsigned long seed, size_t nThreads, bool affinity,
+	      double sampleRate, bool stratified, size_t nCandidates, std::string columnStore, size_t nResidentColumns) {
       using scorer_t = Scorer;
-      using processor_t = TopKProcessor<scorer_t, Partitions>;
-      using miner_t = BranchAndBoundMiner<Partitions, processor_t>;
 
       auto outputStream = std::ref(std::cout);
       std::ofstream outputFile;
@@ -35,14 +52,29 @@ namespace gimlet {
 	outputFile.open(outputFileName, std::ios::out | std::ios::binary);
 	outputStream = outputFile;
       }
-      
-      processor_t processor{K, target, outputStream, scorer};
-      miner_t miner{inputFileName, processor, opus};
-      if(! statsFileName.empty()) processor.statistics().open(statsFileName);
 
-      miner.mine();
-      //   scorer.displayRatio();
-      
+      if(sampleRate > 0.) {
+	if(nPermutations != 0 || nBootstraps != 0)
+	  throw std::invalid_argument("Sampled searches do not support permutations and bootstraps");
+	using processor_t = SampledTopKProcessor<scorer_t, Partitions, ReplicateScorer>;
+	processor_t processor{K, nCandidates == 0 ? 2 * K : nCandidates, target, sampleRate, stratified, confidence, seed, inputFileName, outputStream, scorer, replicateScorer};
+	mine(processor, inputFileName, statsFileName, opus, removeRedundant, columnStore, nResidentColumns, nThreads);
+      } else if(nPermutations == 0 && nBootstraps == 0) {
+	// The top-k is locked only if snapshots read it during the search
+	if(TopKSnapshots::instance().enabled()) {
+	  using processor_t = TopKProcessor<scorer_t, Partitions, true>;
+	  processor_t processor{K, target, outputStream, scorer};
+	  mine(processor, inputFileName, statsFileName, opus, removeRedundant, columnStore, nResidentColumns, nThreads);
+	} else {
+	  using processor_t = TopKProcessor<scorer_t, Partitions>;
+	  processor_t processor{K, target, outputStream, scorer};
+	  mine(processor, inputFileName, statsFileName, opus, removeRedundant, columnStore, nResidentColumns, nThreads);
+	}
+      } else {
+	using processor_t = ResamplingTopKProcessor<scorer_t, Partitions, ReplicateScorer>;
+	processor_t processor{K, target, nPermutations, nBootstraps, confidence, seed, nThreads, affinity, outputStream, scorer, replicateScorer};
+	mine(processor, inputFileName, statsFileName, opus, removeRedundant, columnStore, nResidentColumns, nThreads);
+      }
     }    
   }
 }
@@ -51,9 +83,19 @@ int main(int argc, char *argv[]) {
   using namespace gimlet;
   using namespace gimlet::itemsets;
   try {
-    std::string inputFileName, outputFileName, statsFileName;
-    size_t K; bool opus;
+    std::string inputFileName, outputFileName, outputFormat, statsFileName, memoryLimit, snapshotFileName, columnStore;
+    double snapshotInterval;
+    size_t nResidentColumns;
+    bool hugePages;
+    size_t K; bool opus, removeRedundant;
     int target;
+    size_t nPermutations, nBootstraps;
+    double confidence, sampleRate = 0.;
+    bool stratified;
+    size_t nCandidates;
+    unsigned long seed;
+    size_t nThreads = std::thread::hardware_concurrency();
+    bool affinity;
     {
       namespace po = boost::program_options;
       po::options_description desc("Allowed options");
@@ -64,8 +106,25 @@ int main(int argc, char *argv[]) {
 	("rfi",  "reliable fraction of information")
 	("smi",  po::value<double>()->implicit_value(1.), "smoothed mutual information (with alpha coefficent)")
 	("opus", po::bool_switch(&opus)->default_value(false), "opus optimization")
+	("remove-redundant", po::bool_switch(&removeRedundant), "exclude constant columns and columns equivalent to previous ones from the search, with --rfi only (patterns with such columns are still output)")
+	("permutations", po::value<size_t>(&nPermutations)->default_value(0), "number of target permutations used to estimate the p-values of the top-K patterns")
+	("bootstraps", po::value<size_t>(&nBootstraps)->default_value(0), "number of bootstrap replicates used to estimate confidence intervals of the top-K scores")
+	("confidence", po::value<double>(&confidence)->default_value(0.95), "confidence level of bootstrap intervals and of the bounds of sampled searches")
+	("seed", po::value<unsigned long>(&seed)->default_value(0), "seed of the permutations and bootstrap replicates")
+	("sample", po::value<double>(&sampleRate), "mine a sample of this fraction of the rows, then rescore the candidates on the whole input")
+	("stratified", po::bool_switch(&stratified), "stratify the sample on the target")
+	("candidates", po::value<size_t>(&nCandidates)->default_value(0), "number of candidates kept by a sampled search (2K by default)")
+	("threads", po::value<size_t>(&nThreads), "number of threads (loading the input and resampling)")
+	("affinity", po::bool_switch(&affinity), "pin threads to cores")
+	("memory-limit", po::value<std::string>(&memoryLimit), "soft memory limit (e.g. 512M or 4G) the miner tries to stay below")
+	("column-store", po::value<std::string>(&columnStore), "keep columns out of core in a temporary file of this directory")
+	("resident-columns", po::value<size_t>(&nResidentColumns)->default_value(16), "maximal number of columns held in memory with --column-store")
+	("huge-pages", po::bool_switch(&hugePages), "back large partitions by huge pages")
 	("input", po::value<std::string>(&inputFileName), "input filename")
 	("output", po::value<std::string>(&outputFileName), "output filename")
+	("output-format", po::value<std::string>(&outputFormat)->default_value("json"), "format of the output: json, bin (compact binary, see bin_parser.hpp) or cbor")
+	("snapshots", po::value<std::string>(&snapshotFileName), "file receiving NDJSON snapshots of the current top-k while the search runs")
+	("snapshot-interval", po::value<double>(&snapshotInterval)->default_value(1.), "minimal interval in seconds between two snapshots")
 	("stats", po::value<std::string>(&statsFileName), "statistics filename");
       po::positional_options_description extraOptions;
       extraOptions.add("command", 1);
@@ -73,6 +132,14 @@ int main(int argc, char *argv[]) {
       po::variables_map vm;
       po::store(po::command_line_parser(argc, argv).options(desc).positional(extraOptions).run(), vm);
       po::notify(vm);
+      if(! memoryLimit.empty())
+	cool::MemoryBudget::instance().setLimit(cool::parseMemorySize(memoryLimit));
+      cool::HugePageArena::instance().enable(hugePages);
+      gimlet::output_encoding() = gimlet::parse_encoding(outputFormat);
+      if(! snapshotFileName.empty())
+	TopKSnapshots::instance().open(snapshotFileName, snapshotInterval);
+      if(vm.count("sample") && (sampleRate <= 0. || sampleRate > 1.))
+	throw std::invalid_argument("Sampling rate must be in ]0;1]");
       
       if(argc == 1 || vm.count("help")) {
 	std::cout << desc << "\n";
@@ -82,12 +149,14 @@ int main(int argc, char *argv[]) {
       if(vm.count("rfi")) {
 	using scorer_t = ReliableFractionOfInformation<Partition>;
 	scorer_t scorer{};
-	mine(scorer, inputFileName, outputFileName, statsFileName, opus, K,  target);	
+	ReliableFractionOfInformation<LabelPartition> replicateScorer{};
+	mine(scorer, replicateScorer, inputFileName, outputFileName, statsFileName, opus, removeRedundant, K,  target, nPermutations, nBootstraps, confidence, seed, nThreads, affinity, sampleRate, stratified, nCandidates, columnStore, nResidentColumns);	
       } else if(vm.count("smi")) {
 	using scorer_t = SmoothedInformation<Partition, BOOL_BOUND1, BOOL_BOUND2>;
 	double alpha = vm["smi"].as<double>();
 	scorer_t scorer{alpha};
-	mine(scorer, inputFileName, outputFileName, statsFileName, opus, K,  target);
+	SmoothedInformation<LabelPartition, BOOL_BOUND1, BOOL_BOUND2> replicateScorer{alpha};
+	mine(scorer, replicateScorer, inputFileName, outputFileName, statsFileName, opus, removeRedundant, K,  target, nPermutations, nBootstraps, confidence, seed, nThreads, affinity, sampleRate, stratified, nCandidates, columnStore, nResidentColumns);
       } else
 	throw std::invalid_argument("No scoring function provided among { rfi, smi }");
     }
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Cross-socket penalty of the resampling workers of mine-vert-topK-AFD, before
+# and after --affinity.
+#
+#   benchmarks/affinity.sh <build directory> [input] [threads] [permutations]
+#
+# Every configuration is run 3 times and its best wall time is reported:
+#   remote    workers on the cores of the first NUMA node, memory bound to the
+#             last one: the penalty paid by workers floating away from their data
+#   floating  workers left to the scheduler (before --affinity)
+#   pinned    --affinity: workers pinned node by node, search state first
+#             touched by the workers (after)
+# The remote configuration needs numactl and at least two NUMA nodes.
+
+set -e
+
+build=${1:?usage: $0 <build directory> [input] [threads] [permutations]}
+input=${2:-data/lymphography.json}
+threads=${3:-$(nproc)}
+permutations=${4:-2000}
+miner="$build/algorithms/mine-vert-topK-AFD"
+
+[ -x "$miner" ] || { echo "$miner not found" >&2; exit 1; }
+
+nodes=$(ls -d /sys/devices/system/node/node[0-9]* 2>/dev/null | wc -l)
+last=$((nodes - 1))
+
+best() {
+  for run in 1 2 3; do
+    start=$(date +%s.%N)
+    "$@" > /dev/null
+    end=$(date +%s.%N)
+    echo "$start $end"
+  done | awk '{ time = $2 - $1; if(NR == 1 || time < fastest) fastest = time } END { printf "%.3f", fastest }'
+}
+
+run="$miner --rfi --target -1 --K 10 --permutations $permutations --threads $threads --input $input"
+
+echo "input: $input, threads: $threads, permutations: $permutations, NUMA nodes: $nodes"
+if [ "$nodes" -gt 1 ] && command -v numactl > /dev/null; then
+  echo "remote   $(best numactl --cpunodebind=0 --membind=$last $run) s"
+else
+  echo "remote   skipped (needs numactl and two NUMA nodes)"
+fi
+echo "floating $(best $run) s"
+echo "pinned   $(best $run --affinity) s"
@@ -0,0 +1,60 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <gimlet/mining/column_store.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    namespace {
+      std::runtime_error systemError(const std::string& what) {
+	return std::runtime_error(what + ": " + std::strerror(errno));
+      }
+    }
+
+    ColumnStore::ColumnStore(const std::string& directory) : directory_(directory), fd_(-1), data_(nullptr), size_(0), nRows_(0), columns_() {}
+
+    ColumnStore::~ColumnStore() {
+      unmap();
+    }
+
+    void ColumnStore::unmap() {
+      if(data_) munmap(data_, size_);
+      if(fd_ >= 0) close(fd_);
+      data_ = nullptr;
+      fd_ = -1;
+      size_ = 0;
+    }
+
+    void ColumnStore::allocate(size_t nRows, const std::vector<size_type>& nParts) {
+      unmap();
+      nRows_ = nRows;
+      columns_.clear();
+
+      // Columns are aligned on 4 bytes so that every label is aligned
+      size_t offset = 0;
+      for(size_type n : nParts) {
+	unsigned char width = n <= 0x100 ? 1 : n <= 0x10000 ? 2 : 4;
+	if(n == 0) width = 0;
+	columns_.push_back({offset, width, n});
+	offset += (nRows * width + 3) & ~size_t(3);
+      }
+      if(offset == 0) return;
+
+      std::string path = directory_ + "/gimlet-columns-XXXXXX";
+      fd_ = mkstemp(path.data());
+      if(fd_ < 0) throw systemError("Cannot create column store in " + directory_);
+      unlink(path.c_str());
+      if(ftruncate(fd_, static_cast<off_t>(offset)) != 0) throw systemError("Cannot size column store");
+      void* data = mmap(nullptr, offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+      if(data == MAP_FAILED) throw systemError("Cannot map column store");
+      data_ = static_cast<char*>(data);
+      size_ = offset;
+    }
+  }
+}
@@ -0,0 +1,254 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef GIMLET_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef GIMLET_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+#include <gimlet/compressed_input.hpp>
+
+namespace cool {
+
+  namespace {
+
+    std::uint32_t readLE32(const char* p) {
+      const unsigned char* bytes = reinterpret_cast<const unsigned char*>(p);
+      return std::uint32_t(bytes[0]) | std::uint32_t(bytes[1]) << 8 | std::uint32_t(bytes[2]) << 16 | std::uint32_t(bytes[3]) << 24;
+    }
+
+    /*
+     * Stream buffer reading a file descriptor and decompressing its data into the
+     * get area. The raw data are read by blocks into a separate input buffer, whose
+     * first block also serves to recognize the compression.
+     */
+    class DecompressingBuffer : public std::streambuf {
+      static constexpr size_t bufferSize = size_t(1) << 18;
+
+      int fd_;
+      std::string name_;
+      Compression compression_;
+      std::vector<char> in_, out_;
+      // Raw data read but not consumed yet
+      const char* next_;
+      size_t available_;
+      // True while a gzip member or zstd frame is not complete
+      bool pending_;
+#ifdef GIMLET_HAS_ZLIB
+      z_stream zlib_;
+#endif
+#ifdef GIMLET_HAS_ZSTD
+      ZSTD_DStream* zstd_ = nullptr;
+#endif
+
+      [[noreturn]] void error(const std::string& message) const {
+	throw std::runtime_error("Cannot read " + name_ + ": " + message);
+      }
+
+      size_t readSome(char* data, size_t size) {
+	for(;;) {
+	  const ssize_t n = ::read(fd_, data, size);
+	  if(n >= 0) return static_cast<size_t>(n);
+	  if(errno != EINTR) error(std::strerror(errno));
+	}
+      }
+
+      // Appends raw data to the ones not consumed yet, returns false at the end of the file
+      bool readInput() {
+	std::memmove(in_.data(), next_, available_);
+	next_ = in_.data();
+	const size_t n = readSome(in_.data() + available_, in_.size() - available_);
+	available_ += n;
+	return n != 0;
+      }
+
+      size_t copy() {
+	if(available_ == 0) return readSome(out_.data(), out_.size());
+	const size_t n = available_;
+	std::memcpy(out_.data(), next_, n);
+	available_ = 0;
+	return n;
+      }
+
+#ifdef GIMLET_HAS_ZLIB
+      size_t inflate() {
+	zlib_.next_out = reinterpret_cast<Bytef*>(out_.data());
+	zlib_.avail_out = static_cast<uInt>(out_.size());
+	while(zlib_.avail_out == out_.size()) {
+	  if(available_ == 0 && ! readInput()) {
+	    if(pending_) error("truncated gzip data");
+	    break;
+	  }
+	  // Concatenated members
+	  if(! pending_) {
+	    inflateReset(&zlib_);
+	    pending_ = true;
+	  }
+	  zlib_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(next_));
+	  zlib_.avail_in = static_cast<uInt>(available_);
+	  const int status = ::inflate(&zlib_, Z_NO_FLUSH);
+	  next_ += available_ - zlib_.avail_in;
+	  available_ = zlib_.avail_in;
+	  if(status == Z_STREAM_END) pending_ = false;
+	  else if(status != Z_OK) error(zlib_.msg ? zlib_.msg : "corrupted gzip data");
+	}
+	return out_.size() - zlib_.avail_out;
+      }
+#endif
+
+#ifdef GIMLET_HAS_ZSTD
+      size_t decompress() {
+	ZSTD_outBuffer output{out_.data(), out_.size(), 0};
+	while(output.pos == 0) {
+	  if(available_ == 0 && ! readInput()) {
+	    if(pending_) error("truncated zstd data");
+	    break;
+	  }
+	  ZSTD_inBuffer input{next_, available_, 0};
+	  const size_t status = ZSTD_decompressStream(zstd_, &output, &input);
+	  if(ZSTD_isError(status)) error(ZSTD_getErrorName(status));
+	  next_ += input.pos;
+	  available_ -= input.pos;
+	  // Frames, possibly concatenated, end where the decoder expects no more data
+	  pending_ = status != 0;
+	}
+	return output.pos;
+      }
+#endif
+
+    protected:
+      int_type underflow() override {
+	if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+	size_t n = 0;
+	switch(compression_) {
+	case Compression::none: n = copy(); break;
+#ifdef GIMLET_HAS_ZLIB
+	case Compression::gzip: n = inflate(); break;
+#endif
+#ifdef GIMLET_HAS_ZSTD
+	case Compression::zstd: n = decompress(); break;
+#endif
+	default: break;
+	}
+	if(n == 0) return traits_type::eof();
+	setg(out_.data(), out_.data(), out_.data() + n);
+	return traits_type::to_int_type(*gptr());
+      }
+
+    public:
+      DecompressingBuffer(const std::string& fileName)
+	: fd_(0), name_(fileName.empty() ? "standard input" : fileName), compression_(Compression::none),
+	  in_(bufferSize), out_(bufferSize), next_(in_.data()), available_(0), pending_(true) {
+	if(! fileName.empty()) {
+	  fd_ = ::open(fileName.c_str(), O_RDONLY);
+	  if(fd_ < 0) throw std::runtime_error("Cannot open " + fileName + ": " + std::strerror(errno));
+	}
+	try {
+	  while(available_ < 4 && readInput());
+	  compression_ = detectCompression(next_, available_);
+	  switch(compression_) {
+	  case Compression::none: break;
+	  case Compression::gzip:
+#ifdef GIMLET_HAS_ZLIB
+	    zlib_ = z_stream();
+	    // Automatic detection of the gzip header
+	    if(inflateInit2(&zlib_, 15 + 32) != Z_OK) error("cannot initialize zlib");
+	    break;
+#else
+	    error("gzip compressed data are not supported by this build (zlib not found)");
+#endif
+	  case Compression::zstd:
+#ifdef GIMLET_HAS_ZSTD
+	    zstd_ = ZSTD_createDStream();
+	    if(! zstd_) error("cannot initialize zstd");
+	    break;
+#else
+	    error("zstd compressed data are not supported by this build (zstd not found)");
+#endif
+	  }
+	} catch(...) {
+	  if(fd_ != 0) ::close(fd_);
+	  throw;
+	}
+      }
+
+      ~DecompressingBuffer() {
+#ifdef GIMLET_HAS_ZLIB
+	if(compression_ == Compression::gzip) inflateEnd(&zlib_);
+#endif
+#ifdef GIMLET_HAS_ZSTD
+	ZSTD_freeDStream(zstd_);
+#endif
+	if(fd_ != 0) ::close(fd_);
+      }
+
+      Compression compression() const { return compression_; }
+    };
+  }
+
+  Compression detectCompression(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    if(size >= 2 && bytes[0] == 0x1F && bytes[1] == 0x8B) return Compression::gzip;
+    if(size >= 4 && readLE32(data) == 0xFD2FB528) return Compression::zstd;
+    return Compression::none;
+  }
+
+  InputFile::InputFile(const std::string& fileName) : std::istream(nullptr), buffer_(new DecompressingBuffer(fileName)) {
+    rdbuf(buffer_.get());
+    // Decompression errors are not mistaken for the end of the data
+    exceptions(std::ios::badbit);
+  }
+
+  InputFile::~InputFile() {}
+
+  Compression InputFile::compression() const {
+    return static_cast<const DecompressingBuffer*>(buffer_.get())->compression();
+  }
+
+  bool decompressSeekable(const char* begin, const char* end, ThreadPool& pool, std::vector<char>& data) {
+#ifdef GIMLET_HAS_ZSTD
+    // Seek table: skippable frame header, entries (compressed size, decompressed
+    // size and optional checksum of every frame) and footer (number of frames,
+    // descriptor and magic number)
+    static constexpr std::uint32_t skippableMagic = 0x184D2A5E, seekableMagic = 0x8F92EAB1;
+    static constexpr size_t headerSize = 8, footerSize = 9;
+    const size_t size = end - begin;
+    if(size < headerSize + footerSize || readLE32(end - 4) != seekableMagic) return false;
+    const size_t nFrames = readLE32(end - footerSize);
+    const unsigned char descriptor = static_cast<unsigned char>(end[-5]);
+    // Reserved bits
+    if(descriptor & 0x7C) return false;
+    const size_t entrySize = descriptor & 0x80 ? 12 : 8;
+    const size_t tableSize = nFrames * entrySize + footerSize;
+    if(tableSize > size - headerSize) return false;
+    const char* table = end - tableSize;
+    if(readLE32(table - 8) != skippableMagic || readLE32(table - 4) != tableSize) return false;
+
+    std::vector<size_t> sources(nFrames + 1, 0), targets(nFrames + 1, 0);
+    for(size_t frame = 0; frame != nFrames; ++frame) {
+      sources[frame + 1] = sources[frame] + readLE32(table + frame * entrySize);
+      targets[frame + 1] = targets[frame] + readLE32(table + frame * entrySize + 4);
+    }
+    if(sources[nFrames] != size - tableSize - headerSize) return false;
+
+    data.resize(targets[nFrames]);
+    parallel_for(pool, size_t(0), nFrames, [&] (size_t frame) {
+	const size_t n = targets[frame + 1] - targets[frame];
+	const size_t status = ZSTD_decompress(data.data() + targets[frame], n, begin + sources[frame], sources[frame + 1] - sources[frame]);
+	if(ZSTD_isError(status) || status != n)
+	  throw std::runtime_error("Corrupted frame " + std::to_string(frame) + " of seekable zstd data");
+      }, 1);
+    return true;
+#else
+    (void) begin; (void) end; (void) pool; (void) data;
+    return false;
+#endif
+  }
+}
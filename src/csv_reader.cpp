@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <gimlet/csv_reader.hpp>
+#include <gimlet/data_stream.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    CSVReader::CSVReader(std::istream& is) : is_(&is), delimiter_(','), line_(0), dictionary_(), codes_(), buffer_(), fields_(), nFields_(0) {
+      if(! readLine()) throw std::runtime_error("CSV data without header");
+      // Byte order mark of UTF-8 files
+      if(buffer_.compare(0, 3, "\xEF\xBB\xBF") == 0) buffer_.erase(0, 3);
+
+      size_t counts[4] = {0, 0, 0, 0};
+      const char delimiters[4] = {',', ';', '\t', '|'};
+      bool quoted = false;
+      for(char c : buffer_) {
+	if(c == '"') quoted = ! quoted;
+	else if(! quoted)
+	  for(int i = 0; i != 4; ++i)
+	    if(c == delimiters[i]) ++counts[i];
+      }
+      delimiter_ = delimiters[std::max_element(counts, counts + 4) - counts];
+
+      readRecord();
+      dictionary_.names_.assign(fields_.begin(), fields_.begin() + nFields_);
+      dictionary_.values_.resize(nFields_);
+      codes_.resize(nFields_);
+    }
+
+    bool CSVReader::detect(std::istream& is) {
+      // Standard streams must be unsynchronized from stdio before anything is read
+      initDataStreams();
+      is >> std::ws;
+      const int c = is.peek();
+      return c != '[' && c != std::char_traits<char>::eof();
+    }
+
+    // Reads the next non empty line into the buffer
+    bool CSVReader::readLine() {
+      do {
+	if(! std::getline(*is_, buffer_)) return false;
+	++line_;
+	if(! buffer_.empty() && buffer_.back() == '\r') buffer_.pop_back();
+      } while(buffer_.empty());
+      return true;
+    }
+
+    // Splits the record starting with the line of the buffer into fields
+    void CSVReader::readRecord() {
+      nFields_ = 0;
+      auto nextField = [this] () -> std::string& {
+	if(nFields_ == fields_.size()) fields_.emplace_back();
+	std::string& field = fields_[nFields_++];
+	field.clear();
+	return field;
+      };
+
+      std::string* field = &nextField();
+      bool quoted = false;
+      for(size_t pos = 0;;) {
+	if(pos == buffer_.size()) {
+	  if(! quoted) break;
+	  // Line break inside a quoted field
+	  if(! std::getline(*is_, buffer_))
+	    throw std::runtime_error("Quoted CSV field not closed at end of data (line " + std::to_string(line_) + ")");
+	  ++line_;
+	  if(! buffer_.empty() && buffer_.back() == '\r') buffer_.pop_back();
+	  field->push_back('\n');
+	  pos = 0;
+	  continue;
+	}
+	const char c = buffer_[pos++];
+	if(quoted) {
+	  if(c != '"') field->push_back(c);
+	  else if(pos != buffer_.size() && buffer_[pos] == '"') {
+	    field->push_back('"');
+	    ++pos;
+	  } else
+	    quoted = false;
+	} else if(c == delimiter_)
+	  field = &nextField();
+	else if(c == '"')
+	  quoted = true;
+	else
+	  field->push_back(c);
+      }
+    }
+
+    bool CSVReader::read(row_type& row) {
+      if(! readLine()) return false;
+      readRecord();
+      const size_t nColumns = dictionary_.names_.size();
+      if(nFields_ != nColumns)
+	throw std::runtime_error("CSV line " + std::to_string(line_) + " has " + std::to_string(nFields_) + " fields instead of " + std::to_string(nColumns));
+
+      row.resize(nColumns);
+      for(size_t column = 0; column != nColumns; ++column) {
+	std::vector<std::string>& values = dictionary_.values_[column];
+	auto [it, inserted] = codes_[column].try_emplace(fields_[column], static_cast<value_type>(values.size()));
+	if(inserted) values.push_back(fields_[column]);
+	row[column] = {static_cast<attribute_type>(column), it->second};
+      }
+      return true;
+    }
+  }
+}
@@ -1,23 +1,33 @@
 #include <gimlet/mining/data_partition.hpp>
 #include <gimlet/json_parser.hpp>
 #include <gimlet/data_iterator.hpp>
+#include <gimlet/mapped_file.hpp>
+#include <gimlet/compressed_input.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <optional>
+#include <ranges>
+#include <boost/functional/hash.hpp>
+#include <boost/iterator/filter_iterator.hpp>
 
 namespace gimlet {
   namespace itemsets {
     
     Partition::Cell::Cell() : next_{}, part_{} {}
 
-    void Partition::Part::add(Cell* cell) {
+    void Partition::Part::add(Cell* cell, size_type weight) {
       if(first_) last_->next_ = cell; else first_ = cell;
       last_ = cell;
       cell->part_ = this;
       cell->next_ = nullptr;
-      ++n_;
+      n_ += weight;
     }
 
     bool Partition::Part::empty() { return first_ == nullptr; }
 
-    Partition::Part* Partition::addPart(std::vector<Part>& parts) {
+    Partition::Part* Partition::addPart(parts_t& parts) {
       Part& part = parts.emplace_back();
       return &part;
     }
@@ -32,8 +42,8 @@ namespace gimlet {
     }
       
     void Partition::Rebuilder::rebuildCells(const Cell* oldCellAddr) {
-      std::vector<Cell>& cells = partition_->cells_;
-      std::vector<Part>& parts = partition_->parts_;	  
+      cells_t& cells = partition_->cells_;
+      parts_t& parts = partition_->parts_;	  
       Cell* newCellAddr = cells.data();
       partition_->base_ = newCellAddr;
       partition_->end_ = partition_->base_ + cells.size();
@@ -52,8 +62,8 @@ namespace gimlet {
     }
 	
     void Partition::Rebuilder::rebuildParts(const Part* oldPartAddr) {
-      std::vector<Cell>& cells = partition_->cells_;
-      std::vector<Part>& parts = partition_->parts_;	  
+      cells_t& cells = partition_->cells_;
+      parts_t& parts = partition_->parts_;	  
       Part* newPartAddr = parts.data();
 	  
       for(Cell& cell : cells)
@@ -61,8 +71,8 @@ namespace gimlet {
     }
 
     void Partition::Rebuilder::rebuildCellsAndParts(const Cell* oldCellAddr, const Part* oldPartAddr) {
-      std::vector<Cell>& cells = partition_->cells_;
-      std::vector<Part>& parts = partition_->parts_;	  
+      cells_t& cells = partition_->cells_;
+      parts_t& parts = partition_->parts_;	  
       Cell* newCellAddr = cells.data();
       Part* newPartAddr = parts.data();
 
@@ -84,27 +94,33 @@ namespace gimlet {
 	
     Partition::Rebuilder::Rebuilder(Partition& partition) : partition_(&partition) {}
 	
-    void Partition::Rebuilder::operator()(std::vector<Cell>& cells, Cell* oldAddr) { rebuildCells(oldAddr); }
-    void Partition::Rebuilder::operator()(std::vector<Part>& parts, Part* oldAddr) { rebuildParts(oldAddr); }
+    void Partition::Rebuilder::operator()(cells_t& cells, Cell* oldAddr) { rebuildCells(oldAddr); }
+    void Partition::Rebuilder::operator()(parts_t& parts, Part* oldAddr) { rebuildParts(oldAddr); }
 
-    Partition::Partition() : rebuilder_(*this), base_(), end_(), cells_(rebuilder_), parts_(rebuilder_), nEmptyParts_(0) {
+    Partition::Partition() : rebuilder_(*this), base_(), end_(), weights_(), cells_(rebuilder_), parts_(rebuilder_), nEmptyParts_(0) {
       size_t defaultCapacity = 128;
       parts_.reserve(defaultCapacity);
       cells_.reserve(defaultCapacity);
       base_ = end_ = cells_.data();
     }
       
-    Partition::Partition(Partition&& other) : rebuilder_(*this), base_(other.base_), end_(other.end_), cells_(std::move(other.cells_)), parts_(std::move(other.parts_)), nEmptyParts_(other.nEmptyParts_) {
+    Partition::Partition(Partition&& other) : rebuilder_(*this), base_(other.base_), end_(other.end_), weights_(std::move(other.weights_)), cells_(std::move(other.cells_)), parts_(std::move(other.parts_)), nEmptyParts_(other.nEmptyParts_) {
       other.nEmptyParts_ = 0;
       other.base_ = other.end_ = nullptr;
     }
       
-    Partition::Partition(const Partition& other) : rebuilder_(*this), cells_(other.cells_), parts_(other.parts_), nEmptyParts_(other.nEmptyParts_) {
+    Partition::Partition(const Partition& other) : rebuilder_(*this), weights_(other.weights_), cells_(other.cells_), parts_(other.parts_), nEmptyParts_(other.nEmptyParts_) {
       rebuilder_.rebuildCellsAndParts(other.cells_.data(), other.parts_.data());
     }
 
     bool Partition::empty() const { return cells_.empty(); }
     size_t Partition::size() const { return cells_.size(); }
+    size_t Partition::nRows() const {
+      if(! weights_) return cells_.size();
+      size_t n = 0;
+      for(size_type weight : *weights_) n += weight;
+      return n;
+    }
     size_t Partition::nParts() const { return parts_.size() + nEmptyParts_; }
     size_t Partition::nNonEmptyParts() const { return parts_.size(); }
     size_t Partition::nEmptyParts() const { return nEmptyParts_; }
@@ -115,6 +131,16 @@ namespace gimlet {
       return res;
     }
       
+    // One label per row: merged rows get as many labels as their weight
+    std::vector<Partition::size_type> Partition::labels() const {
+      std::vector<size_type> labels;
+      labels.reserve(nRows());
+      const Part* parts = parts_.data();
+      for(size_type index = 0; index != cells_.size(); ++index)
+	labels.insert(labels.end(), weight(getPtr(index)), static_cast<size_type>(getPtr(index)->part_ - parts));
+      return labels;
+    }
+      
     void Partition::printArray(std::ostream& os) const {
       const Cell* cells = cells_.data();
       const Part* parts = parts_.data();
@@ -160,7 +186,7 @@ namespace gimlet {
       if(nEmptyParts_ > 0)
 	os << " ()x" << nEmptyParts_;
 
-      assert(total == cells_.size());
+      assert(total == nRows());
     }      
 
     std::ostream& operator<<(std::ostream& os, const Partition& column) {
@@ -170,98 +196,409 @@ namespace gimlet {
       return os;
     }
 
-    Partition::Mapper::Mapper(Partition& partition) : partition_(&partition) {}
+    template<typename Value>
+    Partition::Mapper<Value>::Mapper(Partition& partition) : partition_(&partition) {}
 
-    void Partition::Mapper::setPartition(Partition& partition) { partition_ = &partition; }
-	
-    void Partition::Mapper::addCell(value_field_t value) {
+    template<typename Value>
+    void Partition::Mapper<Value>::addCell(Value value, size_type weight) {
       auto& column = partition_->cells_;
 	  
       Cell& cell = column.emplace_back();
 #ifdef _DEBUG
       cell.base_ = column.data();
 #endif
+      // parts_ is grown through its own emplace_back so that the rebuilder re-points the cells when it moves
+      auto& parts = partition_->parts_;
       auto it = this->find(value);
-      Part* part;
+      size_type index;
       if(it == this->end()) {
-	part = addPart(partition_->parts_);
-	(*this)[value] = part;
+	index = static_cast<size_type>(parts.size());
+	parts.emplace_back();
+	(*this)[value] = index;
       } else
-	part = it->second;
-      part->add(&cell);
+	index = it->second;
+      parts[index].add(&cell, weight);
     }
 
-    
-    Partitions::Rebuilder::Rebuilder(Partitions& partitions) : partitions_(&partitions) {}
-	
-    void Partitions::Rebuilder::operator()(std::vector<Partition>& partitions, Partition* oldAddr) {
-      auto it = partitions.begin();
-      for(mapper_t& mapper : partitions_->mappers_) {
-	mapper.setPartition(*it);
-	++it;
-      }
-    }
+    template struct Partition::Mapper<std::uint8_t>;
+    template struct Partition::Mapper<std::uint16_t>;
+    template struct Partition::Mapper<std::uint32_t>;
 
     void Partitions::Iterator::update() {
-      while(*this != end_) {
-	size_type n = (*this)->size();
-	if(n != 0) {
+      while(index_ != end_) {
+	if(! partitions_->absent(index_)) {
+	  size_type n = static_cast<size_type>(partitions_->columnSize(index_));
 	  if(n_ == 0) n_ = n;
 	  else if(n != n_) throw std::runtime_error("Non empty columns should all have the same size");
 	  break;
 	}
-	++(static_cast<parent_iterator &>(*this)); ++index_;
+	++index_;
       }
     }
-    Partitions::Iterator::Iterator(const parent_iterator& it, const parent_iterator& end, field_t index) : parent_iterator(it), end_(end), 
-													   index_(index), n_(0) {
+    Partitions::Iterator::Iterator(Partitions& partitions, field_t index, field_t end) : partitions_(&partitions), index_(index), end_(end), n_(0) {
       update();
     }
-    Partitions::Iterator::Iterator(const Iterator& other) :  parent_iterator(other), end_(other.end_), index_(other.index_), n_(other.n_) {}
 
     Partitions::Iterator& Partitions::Iterator::operator++() {
-      ++(static_cast<parent_iterator &>(*this)); ++index_;
+      ++index_;
       update();
       return *this;
     }
 
+    Partition& Partitions::Iterator::operator*() const { return (*partitions_)[index_]; }
+    Partition* Partitions::Iterator::operator->() const { return &(*partitions_)[index_]; }
     Partitions::field_t Partitions::Iterator::index() { return index_; }
 
-    Partitions::iterator Partitions::begin() { return Iterator(columns_.begin(), columns_.end(), 0); }
-    Partitions::iterator Partitions::end() { return Iterator(columns_.end(), columns_.end(), static_cast<field_t>(columns_.size())); }
+    Partitions::iterator Partitions::begin() { return Iterator(*this, 0, static_cast<field_t>(columns_.size())); }
+    Partitions::iterator Partitions::end() { return Iterator(*this, static_cast<field_t>(columns_.size()), static_cast<field_t>(columns_.size())); }
 
-    Partition::Mapper& Partitions::getMapper(field_t field) {
-      while(field >= columns_.size()) {
-	column_t& col = columns_.emplace_back();
-	mappers_.emplace_back(col);
+    bool Partitions::absent(field_t field) const {
+      if(store_) return store_->nParts(field) == 0;
+      return columns_[field]->empty();
+    }
+
+    size_t Partitions::columnSize(field_t field) const {
+      return store_ ? store_->nRows() : columns_[field]->size();
+    }
+
+    // Materializes a stored column, evicting the least recently used one if needed
+    Partition& Partitions::column(field_t field) const {
+      std::unique_ptr<Partition>& column = columns_[field];
+      if(! store_) return *column;
+
+      if(column) {
+	auto it = std::find(resident_.begin(), resident_.end(), field);
+	if(it != resident_.end()) resident_.splice(resident_.begin(), resident_, it);
+	return *column;
       }
-      return mappers_[field];
+      column = std::make_unique<Partition>();
+      if(store_->nParts(field) == 0) return *column;
+
+      column->weights_ = weights_;
+      Partition::Mapper<size_type> mapper(*column);
+      size_type row = 0;
+      store_->apply(field, [&] (size_type label) { mapper.addCell(label, weights_ ? (*weights_)[row++] : 1); });
+      resident_.push_front(field);
+      if(resident_.size() > nResident_) {
+	columns_[resident_.back()].reset();
+	resident_.pop_back();
+      }
+      return *column;
     }
 
     Partition& Partitions::operator[] (field_t field) {
-      getMapper(field);
-      return columns_[field];
+      while(field >= columns_.size()) columns_.push_back(store_ ? nullptr : std::make_unique<Partition>());
+      return column(field);
     }
 
     const Partition& Partitions::operator[] (field_t field) const {
-      return columns_[field];
+      return column(field);
     }
 
-    Partitions::Partitions() : rebuilder_(*this), top_(), columns_(rebuilder_), mappers_(), topMapper_(top_), size_(0) {}
+    Partitions::Partitions() : top_(), columns_(), size_(0), weights_(), dictionary_(), store_(), nResident_(0), resident_() {}
 
+    void Partitions::setColumnStore(const std::string& directory, size_t nResident) {
+      store_ = std::make_unique<ColumnStore>(directory);
+      nResident_ = std::max<size_t>(nResident, 2);
+    }
+
+    Partition Partitions::remove(field_t field) {
+      Partition removed{std::move((*this)[field])};
+      if(store_) {
+	store_->drop(field);
+	resident_.remove(field);
+	columns_[field] = std::make_unique<Partition>();
+      }
+      return removed;
+    }
+
+    void Partitions::setWeights(std::shared_ptr<const std::vector<size_type>> weights) {
+      weights_ = weights;
+      top_.weights_ = weights;
+      for(auto& column : columns_)
+	if(column) column->weights_ = weights;
+    }
+
+    // Values are labelled by order of first appearance, as parts are numbered in partitions
+    template<typename Value>
+    void Partitions::store(const RowSet<Value>& rows, field_t nColumns) {
+      std::vector<std::unordered_map<Value, size_type>> labels(nColumns);
+      std::vector<size_t> nCells(nColumns, 0);
+      for(const auto* row : rows.rows_)
+	for(const auto& [field, value] : *row) {
+	  labels[field].try_emplace(value, static_cast<size_type>(labels[field].size()));
+	  ++nCells[field];
+	}
+
+      std::vector<size_type> nParts(nColumns);
+      for(field_t field = 0; field != nColumns; ++field) {
+	if(nCells[field] != 0 && nCells[field] != rows.rows_.size())
+	  throw std::runtime_error("Non empty columns should all have the same size");
+	nParts[field] = static_cast<size_type>(labels[field].size());
+      }
+      store_->allocate(rows.rows_.size(), nParts);
+
+      for(size_type index = 0; index != rows.rows_.size(); ++index)
+	for(const auto& [field, value] : *rows.rows_[index])
+	  store_->set(field, index, labels[field].find(value)->second);
+    }
+
+    // Columns are created at once so that mappers keep pointing to them
+    template<typename Value>
+    void Partitions::build(const RowSet<Value>& rows, cool::ThreadPool* pool) {
+      field_t nColumns = 0;
+      for(const auto* row : rows.rows_)
+	if(! row->empty()) nColumns = std::max<field_t>(nColumns, row->back().first + 1);
+      while(columns_.size() < nColumns) columns_.push_back(store_ ? nullptr : std::make_unique<Partition>());
+
+      Partition::Mapper<Value> topMapper(top_);
+      for(size_type index = 0; index != rows.rows_.size(); ++index)
+	topMapper.addCell(1, rows.weights_[index]);
+      size_ = rows.size_;
+      if(rows.rows_.size() != rows.size_)
+	setWeights(std::make_shared<const std::vector<size_type>>(rows.weights_));
+
+      if(store_) {
+	store(rows, nColumns);
+	return;
+      }
+      std::vector<Partition::Mapper<Value>> mappers;
+      for(auto& column : columns_) mappers.emplace_back(*column);
+      if(! pool) {
+	for(size_type index = 0; index != rows.rows_.size(); ++index) {
+	  const size_type weight = rows.weights_[index];
+	  for(const auto& [field, value] : *rows.rows_[index])
+	    mappers[field].addCell(value, weight);
+	}
+	return;
+      }
+
+      // Every task fills a block of columns, scanning the rows (sorted by field) in order
+      const size_t nBlocks = std::min<size_t>(nColumns, 4 * (pool->size() + 1));
+      cool::parallel_for(*pool, size_t(0), nBlocks, [&] (size_t block) {
+	  const field_t first = static_cast<field_t>(nColumns * block / nBlocks), last = static_cast<field_t>(nColumns * (block + 1) / nBlocks);
+	  for(size_type index = 0; index != rows.rows_.size(); ++index) {
+	    const size_type weight = rows.weights_[index];
+	    const auto& row = *rows.rows_[index];
+	    auto it = std::lower_bound(row.begin(), row.end(), first, [] (const auto& pair, field_t field) { return pair.first < field; });
+	    for(; it != row.end() && it->first < last; ++it)
+	      mappers[it->first].addCell(it->second, weight);
+	  }
+	}, 1);
+    }
+
+    // Identical rows are merged into a single cell weighted by their number of occurrences.
+    // Rows are kept with the narrowest value type holding all values until the columns are built.
     void Partitions::load(std::istream& is) {
-      using pattern_type = std::vector<std::pair<field_t, value_field_t>>;
-      auto JSON_parser = gimlet::make_JSON_parser<flow<pattern_type>>();
-      auto input_stream = gimlet::make_input_data_stream(is, JSON_parser);
-      auto data = gimlet::make_input_data_begin<decltype(input_stream), pattern_type>(input_stream);
-      auto end = gimlet::make_input_data_end<decltype(input_stream), pattern_type>(input_stream);
-
-      if(data != end) {
-	columns_.reserve(data->size()+1);
-	do {
-	  add(*data); ++size_; ++data;
-	} while(data != end);
+      read_rows(is, [this] (auto begin, auto end) {
+	store_with_narrowest_values<RowSet>(begin, end, [this](const auto& rows) { build(rows); });
+      }, dictionary_);
+    }
+
+    void Partitions::load(std::istream& is, const row_filter_t& keep) {
+      using pattern_type = valued_row_type<wide_attribute_value_type>;
+      auto predicate = [&keep] (const pattern_type& row) { return keep(row); };
+      read_rows(is, [&] (auto begin, auto end) {
+	store_with_narrowest_values<RowSet>(boost::make_filter_iterator(predicate, begin, end), boost::make_filter_iterator(predicate, end, end),
+					    [this](const auto& rows) { build(rows); });
+      }, dictionary_);
+    }
+
+    const Dictionary& Partitions::dictionary() const { return dictionary_; }
+
+    struct Partitions::ParsedChunk {
+      std::vector<std::pair<attribute_type, wide_attribute_value_type>> pairs_;
+      // Rows are stored one after the other, ends_ giving where each one ends in pairs_
+      std::vector<size_t> ends_;
+      wide_attribute_value_type maxValue_ = 0;
+    };
+
+    namespace {
+      // Scanner of the flows of rows written as [[field, value], ...]
+      class RowScanner {
+	const char* base_;
+
+	[[noreturn]] void error(const char* pos, const char* expected) const {
+	  throw std::runtime_error("JSON syntax error at byte " + std::to_string(pos - base_) + ": " + expected + " expected");
+	}
+
+      public:
+	RowScanner(const char* base) : base_(base) {}
+
+	static const char* skipSpaces(const char* it, const char* end) {
+	  while(it != end && std::isspace(static_cast<unsigned char>(*it))) ++it;
+	  return it;
+	}
+
+	// Previous non space character of [begin, it[ (nullptr if none)
+	static const char* previous(const char* begin, const char* it) {
+	  while(it != begin)
+	    if(! std::isspace(static_cast<unsigned char>(*--it))) return it;
+	  return nullptr;
+	}
+
+	const char* expect(const char* it, const char* end, char c, const char* expected) const {
+	  it = skipSpaces(it, end);
+	  if(it == end || *it != c) error(it, expected);
+	  return it + 1;
+	}
+
+	template<typename Int>
+	const char* integer(const char* it, const char* end, Int& value) const {
+	  it = skipSpaces(it, end);
+	  auto [ptr, ec] = std::from_chars(it, end, value);
+	  if(ec != std::errc()) error(it, "a non negative integer");
+	  return ptr;
+	}
+
+	/*
+	 * First coma of [it, end[ separating two rows, i.e. following a right bracket
+	 * that closes a row: the previous token is then a right bracket closing a pair
+	 * or the left bracket of an empty row.
+	 */
+	static const char* nextSeparator(const char* begin, const char* it, const char* end) {
+	  for(; it != end; ++it) {
+	    if(*it != ',') continue;
+	    const char* bracket = previous(begin, it);
+	    if(! bracket || *bracket != ']') continue;
+	    const char* before = previous(begin, bracket);
+	    if(before && (*before == ']' || *before == '[')) return it;
+	  }
+	  return end;
+	}
+
+	/* Splits the rows of [begin, end[ into at most n chunks of about the same size (separators excluded) */
+	static std::vector<std::pair<const char*, const char*>> split(const char* begin, const char* end, size_t n) {
+	  std::vector<std::pair<const char*, const char*>> chunks;
+	  const char* first = begin;
+	  for(size_t index = 1; index < n; ++index) {
+	    const char* target = std::max(first, begin + static_cast<size_t>(end - begin) * index / n);
+	    const char* separator = nextSeparator(begin, target, end);
+	    if(separator == end) break;
+	    chunks.emplace_back(first, separator);
+	    first = separator + 1;
+	  }
+	  chunks.emplace_back(first, end);
+	  return chunks;
+	}
+
+	/* Parses the rows of [it, end[, separated by comas, into a parsed chunk */
+	template<typename Chunk>
+	void scan(const char* it, const char* end, Chunk& chunk) const {
+	  it = skipSpaces(it, end);
+	  while(it != end) {
+	    it = expect(it, end, '[', "a row");
+	    it = skipSpaces(it, end);
+	    if(it != end && *it == ']')
+	      ++it;
+	    else
+	      for(;;) {
+		attribute_type field;
+		wide_attribute_value_type value;
+		it = expect(it, end, '[', "a pair");
+		it = integer(it, end, field);
+		it = expect(it, end, ',', "a coma");
+		it = integer(it, end, value);
+		it = expect(it, end, ']', "a right square bracket");
+		chunk.pairs_.emplace_back(field, value);
+		chunk.maxValue_ = std::max(chunk.maxValue_, value);
+		it = skipSpaces(it, end);
+		if(it != end && *it == ']') {
+		  ++it;
+		  break;
+		}
+		it = expect(it, end, ',', "a coma");
+	      }
+	    chunk.ends_.push_back(chunk.pairs_.size());
+	    it = skipSpaces(it, end);
+	    if(it != end) {
+	      it = expect(it, end, ',', "a coma");
+	      if(skipSpaces(it, end) == end) error(it, "a row");
+	    }
+	  }
+	}
+      };
+    }
+
+    void Partitions::load(const std::string& fileName, size_t nThreads) {
+      if(! fileName.empty() && nThreads > 1) {
+	cool::MappedFile file(fileName);
+	switch(cool::detectCompression(file.begin(), file.size())) {
+	case cool::Compression::none:
+	  if(load(file.begin(), file.end(), nThreads, nullptr)) return;
+	  break;
+	case cool::Compression::zstd: {
+	  // Seekable zstd files are decompressed frame by frame in parallel
+	  cool::ThreadPool pool{nThreads - 1};
+	  std::vector<char> data;
+	  if(cool::decompressSeekable(file.begin(), file.end(), pool, data)) {
+	    if(! load(data.data(), data.data() + data.size(), nThreads, &pool)) {
+	      // CSV or small data are read in place
+	      struct MemoryBuffer : std::streambuf {
+		MemoryBuffer(char* begin, char* end) { setg(begin, begin, end); }
+	      } buffer(data.data(), data.data() + data.size());
+	      std::istream is(&buffer);
+	      load(is);
+	    }
+	    return;
+	  }
+	  break;
+	}
+	default:
+	  break;
+	}
       }
+      // Standard input, compressed streams, CSV data and small files are read as streams
+      cool::InputFile is(fileName);
+      load(is);
+    }
+
+    bool Partitions::load(const char* begin, const char* end, size_t nThreads, cool::ThreadPool* pool) {
+      // Chunks smaller than this are not worth a task
+      static constexpr size_t minChunkSize = size_t(1) << 20;
+
+      const RowScanner scanner(begin);
+      const char* first = RowScanner::skipSpaces(begin, end);
+      const size_t nChunks = std::min(4 * nThreads, size_t(end - begin) / minChunkSize);
+      if(nChunks <= 1 || first == end || *first != '[') return false;
+      const char* last = RowScanner::previous(first + 1, end);
+      if(! last || *last != ']') throw std::runtime_error("JSON flow does not end with a right square bracket");
+
+      std::optional<cool::ThreadPool> ownPool;
+      if(! pool) pool = &ownPool.emplace(nThreads - 1);
+      auto ranges = RowScanner::split(first + 1, last, nChunks);
+      std::vector<ParsedChunk> chunks(ranges.size());
+      cool::parallel_for(*pool, size_t(0), ranges.size(), [&] (size_t index) {
+	  scanner.scan(ranges[index].first, ranges[index].second, chunks[index]);
+	}, 1);
+
+      wide_attribute_value_type maxValue = 0;
+      for(const ParsedChunk& chunk : chunks) maxValue = std::max(maxValue, chunk.maxValue_);
+      dictionary_ = Dictionary();
+      if(maxValue <= std::numeric_limits<std::uint8_t>::max()) load<std::uint8_t>(chunks, *pool);
+      else if(maxValue <= std::numeric_limits<std::uint16_t>::max()) load<std::uint16_t>(chunks, *pool);
+      else load<std::uint32_t>(chunks, *pool);
+      return true;
+    }
+
+    // Chunks are turned into sets of distinct rows in parallel, then merged in order
+    template<typename Value>
+    void Partitions::load(std::vector<ParsedChunk>& chunks, cool::ThreadPool& pool) {
+      std::vector<RowSet<Value>> sets(chunks.size());
+      cool::parallel_for(pool, size_t(0), chunks.size(), [&] (size_t index) {
+	  ParsedChunk& chunk = chunks[index];
+	  size_t begin = 0;
+	  for(size_t end : chunk.ends_) {
+	    sets[index].push(std::ranges::subrange(chunk.pairs_.begin() + begin, chunk.pairs_.begin() + end));
+	    begin = end;
+	  }
+	  chunk = ParsedChunk();
+	}, 1);
+
+      RowSet<Value> rows = std::move(sets.front());
+      for(size_t index = 1; index != sets.size(); ++index) rows.merge(std::move(sets[index]));
+      sets.clear();
+      build(rows, &pool);
     }
 
     const Partitions::column_t& Partitions::top() const { return top_; }
@@ -270,8 +607,11 @@ namespace gimlet {
     std::ostream& operator<<(std::ostream& os, const Partitions& columns) {
       Partitions::field_t field = 0;
       os << "T) " << columns.top_ << std::endl;
-      for(const auto& partition : columns.columns_)
-	os << field++ << ") " << partition << std::endl;
+      for(const auto& partition : columns.columns_) {
+	os << field++ << ") ";
+	if(partition) os << *partition;
+	os << std::endl;
+      }
       return os;
     }    
   }
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+#include <gimlet/internal/parser.hpp>
+
+namespace gimlet {
+
+  using namespace format;
+
+  /*
+   * Compact binary encoding of the data formats:
+   * - unsigned integers are LEB128 varints, signed ones zigzag-encoded varints,
+   * - floating point numbers are raw little-endian IEEE 754 values,
+   * - lists and strings are their varint length followed by their elements,
+   * - tuples are their components in order,
+   * - named indices are their index (names are not written),
+   * - flows start with the magic number "\x89" "BIN" and every element is
+   *   preceded by a byte 1, a byte 0 ending the flow.
+   */
+  template<typename Format> struct BINParserBase : public ParserBase<Format> {};
+
+  template<typename Format, typename Enable = void>
+  struct BINParser {
+  };
+
+  namespace internal {
+    inline int getByte(std::istream& is) {
+      const int c = is.get();
+      if(c == std::char_traits<char>::eof()) throw formatError("binary data end unexpectedly");
+      return c;
+    }
+
+    inline void writeVarint(std::ostream& os, std::uint64_t value) {
+      char bytes[10];
+      int n = 0;
+      while(value >= 0x80) {
+	bytes[n++] = static_cast<char>(value | 0x80);
+	value >>= 7;
+      }
+      bytes[n++] = static_cast<char>(value);
+      os.write(bytes, n);
+    }
+
+    inline std::uint64_t readVarint(std::istream& is) {
+      std::uint64_t value = 0;
+      for(int shift = 0; shift < 64; shift += 7) {
+	const int c = getByte(is);
+	value |= std::uint64_t(c & 0x7F) << shift;
+	if(! (c & 0x80)) return value;
+      }
+      throw formatError("binary varint longer than 64 bits");
+    }
+  }
+
+  template<typename Format>
+  struct BINParser<Format, std::enable_if_t<std::is_integral_v<Format>>> : public BINParserBase<Format> {
+    template<typename Value>
+      void read(std::istream& is, Value& val) const {
+      const std::uint64_t n = internal::readVarint(is);
+      if constexpr(std::is_signed_v<Format>)
+	val = static_cast<Value>(static_cast<Format>(static_cast<std::int64_t>(n >> 1) ^ -static_cast<std::int64_t>(n & 1)));
+      else
+	val = static_cast<Value>(static_cast<Format>(n));
+    }
+
+    template<typename Value>
+      void write(std::ostream& os, const Value& val) const {
+      if constexpr(std::is_signed_v<Format>) {
+	const std::int64_t i = static_cast<Format>(val);
+	internal::writeVarint(os, (static_cast<std::uint64_t>(i) << 1) ^ static_cast<std::uint64_t>(i >> 63));
+      } else
+	internal::writeVarint(os, static_cast<Format>(val));
+    }
+  };
+
+  template<typename Format>
+  struct BINParser<Format, std::enable_if_t<std::is_floating_point_v<Format>>> : public BINParserBase<Format> {
+    using bits_type = std::conditional_t<sizeof(Format) == 4, std::uint32_t, std::uint64_t>;
+    static_assert(sizeof(Format) == sizeof(bits_type), "floating point numbers must be 32 or 64 bits wide");
+
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, Format>>
+      read(std::istream& is, Value& number) const {
+      bits_type bits = 0;
+      for(size_t i = 0; i != sizeof(bits_type); ++i)
+	bits |= bits_type(internal::getByte(is)) << (8 * i);
+      number = static_cast<Value>(std::bit_cast<Format>(bits));
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, Format>>
+      write(std::ostream& os, const Value& number) const {
+      bits_type bits = std::bit_cast<bits_type>(static_cast<Format>(number));
+      char bytes[sizeof(bits_type)];
+      for(size_t i = 0; i != sizeof(bits_type); ++i, bits >>= 8)
+	bytes[i] = static_cast<char>(bits & 0xFF);
+      os.write(bytes, sizeof(bits_type));
+    }
+  };
+
+  template<typename Char>
+  struct BINParser<basic_string<Char>> : public BINParserBase<basic_string<Char>> {
+    using typename ParserBase<basic_string<Char>>::data_format;
+
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, data_format>>
+      read(std::istream& is, Value& str) const {
+      str.resize(internal::readVarint(is));
+      if(! is.read(str.data(), str.size())) throw internal::formatError("binary data end unexpectedly");
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, data_format>>
+      write(std::ostream& os, const Value& str) const {
+      internal::writeVarint(os, str.size());
+      os.write(str.data(), str.size());
+    }
+  };
+
+  template<typename Format>
+  struct BINParser<named<Format>> : public BINParserBase<named<Format>> {
+    BINParser<Format> indexParser_;
+
+    template<typename Value>
+      void read(std::istream& is, Value& index) const {
+      indexParser_.read(is, index);
+    }
+
+    template<typename Value>
+      void write(std::ostream& os, const Value& index) const {
+      indexParser_.write(os, index);
+    }
+  };
+
+  template<typename Format>
+  struct BINParser<list<Format>> : BINParserBase<list<Format>> {
+    using typename ParserBase<list<Format>>::data_format;
+
+    BINParser<Format> elementParser_;
+
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, data_format>>
+      read(std::istream& is, Value& seq) const {
+      seq.clear();
+      std::back_insert_iterator<Value> ii(seq);
+      typename Value::value_type d;
+      for(std::uint64_t n = internal::readVarint(is); n != 0; --n) {
+	elementParser_.read(is, d);
+	*ii++ = std::move(d);
+      }
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, data_format>>
+      write(std::ostream& os, const Value& seq) const {
+      internal::writeVarint(os, std::size(seq));
+      for(const auto& element : seq)
+	elementParser_.write(os, element);
+    }
+  };
+
+  template<typename ... Args> class BINParser<tuple<Args...>> : public BINParserBase<gimlet::tuple<Args...>> {
+    using typename ParserBase<tuple<Args...>>::data_format;
+
+    std::tuple<BINParser<Args>...> parsers_;
+
+  public:
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, data_format>>
+      read(std::istream& is, Value& t) const {
+      [&]<size_t... i>(std::index_sequence<i...>) {
+	(std::get<i>(parsers_).read(is, std::get<i>(t)), ...);
+      }(std::index_sequence_for<Args...>{});
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, data_format>>
+      write(std::ostream& os, const Value& t) const {
+      [&]<size_t... i>(std::index_sequence<i...>) {
+	(std::get<i>(parsers_).write(os, std::get<i>(t)), ...);
+      }(std::index_sequence_for<Args...>{});
+    }
+  };
+
+  /* First bytes of binary flows */
+  inline const std::string& BIN_magic() {
+    static const std::string magic = "\x89" "BIN";
+    return magic;
+  }
+
+  template<typename Format> class BINParser<flow<Format>> : public BINParserBase<flow<Format>> {
+    using typename ParserBase<gimlet::flow<Format>>::data_format;
+    using element_format = data_format_t<Format>;
+    BINParser<element_format> elementParser_;
+    mutable bool finished_ = false;
+
+  public:
+    bool finished() const { return finished_; }
+
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value,data_format>>
+      read(std::istream& is, Value& val) const {
+      switch(internal::getByte(is)) {
+      case 0: finished_ = true; break;
+      case 1: elementParser_.read(is, val); break;
+      default: throw internal::formatError("binary flow elements are preceded by a byte 1");
+      }
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value,data_format>>
+      write(std::ostream& os, const Value& val) const {
+      os.put(1);
+      elementParser_.write(os, val);
+    }
+
+    void readBegin(std::istream& is) const {
+      for(char c : BIN_magic())
+	if(is.get() != static_cast<unsigned char>(c)) throw internal::formatError("a binary flow starts with its magic number");
+    }
+
+    void readEnd(std::istream& is) const {
+      if(! finished_) {
+	finished_ = true;
+	if(internal::getByte(is) != 0) throw internal::formatError("a binary flow ends with a byte 0");
+      }
+    }
+
+    void writeBegin(std::ostream& os) const {
+      os << BIN_magic();
+    }
+
+    void writeEnd(std::ostream& os) const {
+      if(! finished_) {
+	finished_ = true;
+	os.put(0);
+      }
+    }
+  };
+
+  template<typename Format>
+  using BIN_typed_flow_t = BINParser<flow<Format>>;
+
+  template<typename Data>
+  BINParser<data_format_t<Data>> make_BIN_parser() {
+    return {};
+  }
+}
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include <gimlet/internal/parser.hpp>
+#include <gimlet/json_parser.hpp>
+
+namespace gimlet {
+
+  using namespace format;
+
+  /*
+   * CBOR (RFC 8949) encoding of the data formats: integers are unsigned or
+   * negative integers, floating point numbers are floats or doubles (halves and
+   * integers being also read), strings are text strings, lists and tuples are
+   * arrays, maps are maps and flows are indefinite-length arrays. Named indices
+   * are written as text strings when the stream has names (see set_names) and as
+   * integers otherwise. Lists and maps are read whether their length is definite
+   * or not.
+   */
+  template<typename Format> struct CBORParserBase : public ParserBase<Format> {};
+
+  template<typename Format, typename Enable = void>
+  struct CBORParser {
+  };
+
+  namespace internal {
+    namespace cbor {
+      enum major_type : int { unsigned_integer = 0, negative_integer = 1, byte_string = 2, text_string = 3, array = 4, map = 5, tag = 6, simple = 7 };
+
+      // Additional information of indefinite lengths, and break code ending them
+      constexpr int indefinite = 31;
+      constexpr int break_code = 0xFF;
+
+      inline int getByte(std::istream& is) {
+	const int c = is.get();
+	if(c == std::char_traits<char>::eof()) throw formatError("CBOR data end unexpectedly");
+	return c;
+      }
+
+      inline std::uint64_t readBigEndian(std::istream& is, int n) {
+	std::uint64_t value = 0;
+	for(int i = 0; i != n; ++i) value = (value << 8) | std::uint64_t(getByte(is));
+	return value;
+      }
+
+      inline void writeBigEndian(std::ostream& os, std::uint64_t value, int n) {
+	char bytes[8];
+	for(int i = n - 1; i >= 0; --i, value >>= 8) bytes[i] = static_cast<char>(value & 0xFF);
+	os.write(bytes, n);
+      }
+
+      /* Initial byte of a data item followed by its argument in the shortest form */
+      inline void writeHead(std::ostream& os, int major, std::uint64_t argument) {
+	const char type = static_cast<char>(major << 5);
+	if(argument < 24) os.put(static_cast<char>(type | argument));
+	else if(argument <= 0xFF) { os.put(static_cast<char>(type | 24)); writeBigEndian(os, argument, 1); }
+	else if(argument <= 0xFFFF) { os.put(static_cast<char>(type | 25)); writeBigEndian(os, argument, 2); }
+	else if(argument <= 0xFFFFFFFF) { os.put(static_cast<char>(type | 26)); writeBigEndian(os, argument, 4); }
+	else { os.put(static_cast<char>(type | 27)); writeBigEndian(os, argument, 8); }
+      }
+
+      struct Head {
+	int major_;
+	int info_;
+	std::uint64_t argument_;
+
+	bool indefinite() const { return info_ == cbor::indefinite; }
+      };
+
+      /* Reads the initial byte and argument of the next data item, tags being skipped */
+      inline Head readHead(std::istream& is) {
+	for(;;) {
+	  const int c = getByte(is);
+	  Head head{c >> 5, c & 0x1F, 0};
+	  if(head.info_ < 24) head.argument_ = static_cast<std::uint64_t>(head.info_);
+	  else if(head.info_ <= 27) head.argument_ = readBigEndian(is, 1 << (head.info_ - 24));
+	  else if(head.info_ != indefinite) throw formatError("reserved CBOR additional information");
+	  if(head.major_ != tag) return head;
+	}
+      }
+
+      inline Head expectHead(std::istream& is, int major, const char* what) {
+	Head head = readHead(is);
+	if(head.major_ != major) throw formatError(std::string("CBOR ") + what + " expected");
+	return head;
+      }
+
+      /* True if the next byte ends an indefinite-length item (the byte is then consumed) */
+      inline bool readBreak(std::istream& is) {
+	if(is.peek() != break_code) return false;
+	is.get();
+	return true;
+      }
+
+      inline double halfToDouble(std::uint64_t half) {
+	const int exponent = static_cast<int>((half >> 10) & 0x1F), mantissa = static_cast<int>(half & 0x3FF);
+	double value;
+	if(exponent == 0) value = std::ldexp(mantissa, -24);
+	else if(exponent != 31) value = std::ldexp(mantissa + 1024, exponent - 25);
+	else value = mantissa == 0 ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+	return half & 0x8000 ? -value : value;
+      }
+    }
+  }
+
+  template<typename Format>
+  struct CBORParser<Format, std::enable_if_t<std::is_integral_v<Format>>> : public CBORParserBase<Format> {
+    template<typename Value>
+      void read(std::istream& is, Value& val) const {
+      using namespace internal::cbor;
+      const Head head = readHead(is);
+      if(head.major_ == unsigned_integer) val = static_cast<Value>(static_cast<Format>(head.argument_));
+      else if(head.major_ == negative_integer) val = static_cast<Value>(static_cast<Format>(-1 - static_cast<std::int64_t>(head.argument_)));
+      else if(head.major_ == simple && (head.info_ == 20 || head.info_ == 21)) val = static_cast<Value>(head.info_ == 21);
+      else throw internal::formatError("CBOR integer expected");
+    }
+
+    template<typename Value>
+      void write(std::ostream& os, const Value& val) const {
+      using namespace internal::cbor;
+      const Format i = static_cast<Format>(val);
+      if constexpr(std::is_signed_v<Format>) {
+	if(i < 0) {
+	  writeHead(os, negative_integer, static_cast<std::uint64_t>(-1 - static_cast<std::int64_t>(i)));
+	  return;
+	}
+      }
+      writeHead(os, unsigned_integer, static_cast<std::uint64_t>(i));
+    }
+  };
+
+  template<typename Format>
+  struct CBORParser<Format, std::enable_if_t<std::is_floating_point_v<Format>>> : public CBORParserBase<Format> {
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, Format>>
+      read(std::istream& is, Value& number) const {
+      using namespace internal::cbor;
+      const Head head = readHead(is);
+      if(head.major_ == simple && head.info_ == 25) number = static_cast<Value>(halfToDouble(head.argument_));
+      else if(head.major_ == simple && head.info_ == 26) number = static_cast<Value>(std::bit_cast<float>(static_cast<std::uint32_t>(head.argument_)));
+      else if(head.major_ == simple && head.info_ == 27) number = static_cast<Value>(std::bit_cast<double>(head.argument_));
+      else if(head.major_ == unsigned_integer) number = static_cast<Value>(head.argument_);
+      else if(head.major_ == negative_integer) number = static_cast<Value>(-1. - static_cast<double>(head.argument_));
+      else throw internal::formatError("CBOR floating point number expected");
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, Format>>
+      write(std::ostream& os, const Value& number) const {
+      using namespace internal::cbor;
+      if constexpr(sizeof(Format) == 4) {
+	os.put(static_cast<char>(0xFA));
+	writeBigEndian(os, std::bit_cast<std::uint32_t>(static_cast<float>(number)), 4);
+      } else {
+	os.put(static_cast<char>(0xFB));
+	writeBigEndian(os, std::bit_cast<std::uint64_t>(static_cast<double>(number)), 8);
+      }
+    }
+  };
+
+  template<typename Char>
+  struct CBORParser<basic_string<Char>> : public CBORParserBase<basic_string<Char>> {
+    using typename ParserBase<basic_string<Char>>::data_format;
+
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, data_format>>
+      read(std::istream& is, Value& str) const {
+      using namespace internal::cbor;
+      const Head head = expectHead(is, text_string, "text string");
+      if(head.indefinite()) {
+	// Concatenation of definite-length chunks
+	str.clear();
+	Value chunk;
+	while(! readBreak(is)) {
+	  read(is, chunk);
+	  str += chunk;
+	}
+      } else {
+	str.resize(head.argument_);
+	if(! is.read(str.data(), str.size())) throw internal::formatError("CBOR data end unexpectedly");
+      }
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, data_format>>
+      write(std::ostream& os, const Value& str) const {
+      internal::cbor::writeHead(os, internal::cbor::text_string, str.size());
+      os.write(str.data(), str.size());
+    }
+  };
+
+  /* Indices read as integers and written as text strings when the stream has names (see set_names) */
+  template<typename Format>
+  struct CBORParser<named<Format>> : public CBORParserBase<named<Format>> {
+    CBORParser<Format> indexParser_;
+    CBORParser<gimlet::string> nameParser_;
+
+    template<typename Value>
+      void read(std::istream& is, Value& index) const {
+      indexParser_.read(is, index);
+    }
+
+    template<typename Value>
+      void write(std::ostream& os, const Value& index) const {
+      const auto* names = static_cast<const std::vector<std::string>*>(os.pword(names_index()));
+      if(names && static_cast<size_t>(index) < names->size())
+	nameParser_.write(os, (*names)[index]);
+      else
+	indexParser_.write(os, index);
+    }
+  };
+
+  template<typename Format>
+  struct CBORParser<list<Format>> : CBORParserBase<list<Format>> {
+    using typename ParserBase<list<Format>>::data_format;
+
+    CBORParser<Format> elementParser_;
+
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, data_format>>
+      read(std::istream& is, Value& seq) const {
+      using namespace internal::cbor;
+      seq.clear();
+      const Head head = expectHead(is, array, "array");
+      std::back_insert_iterator<Value> ii(seq);
+      typename Value::value_type d;
+      for(std::uint64_t n = head.argument_; head.indefinite() ? ! readBreak(is) : n-- != 0;) {
+	elementParser_.read(is, d);
+	*ii++ = std::move(d);
+      }
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, data_format>>
+      write(std::ostream& os, const Value& seq) const {
+      internal::cbor::writeHead(os, internal::cbor::array, std::size(seq));
+      for(const auto& element : seq)
+	elementParser_.write(os, element);
+    }
+  };
+
+  template<typename KeyFormat, typename ValueFormat>
+  struct CBORParser<map<KeyFormat, ValueFormat>> : CBORParserBase<map<KeyFormat, ValueFormat>> {
+    using typename ParserBase<map<KeyFormat, ValueFormat>>::data_format;
+
+    CBORParser<KeyFormat> keyParser_;
+    CBORParser<ValueFormat> valueParser_;
+
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, data_format>>
+      read(std::istream& is, Value& dict) const {
+      dict.clear();
+      const internal::cbor::Head head = internal::cbor::expectHead(is, internal::cbor::map, "map");
+      typename Value::key_type key;
+      typename Value::mapped_type value;
+      for(std::uint64_t n = head.argument_; head.indefinite() ? ! internal::cbor::readBreak(is) : n-- != 0;) {
+	keyParser_.read(is, key);
+	valueParser_.read(is, value);
+	dict.insert_or_assign(std::move(key), std::move(value));
+      }
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, data_format>>
+      write(std::ostream& os, const Value& dict) const {
+      internal::cbor::writeHead(os, internal::cbor::map, dict.size());
+      for(const auto& [key, value] : dict) {
+	keyParser_.write(os, key);
+	valueParser_.write(os, value);
+      }
+    }
+  };
+
+  template<typename ... Args> class CBORParser<tuple<Args...>> : public CBORParserBase<gimlet::tuple<Args...>> {
+    using typename ParserBase<tuple<Args...>>::data_format;
+
+    std::tuple<CBORParser<Args>...> parsers_;
+
+  public:
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, data_format>>
+      read(std::istream& is, Value& t) const {
+      using namespace internal::cbor;
+      const Head head = expectHead(is, array, "array");
+      if(! head.indefinite() && head.argument_ != sizeof...(Args))
+	throw internal::formatError("CBOR array of " + std::to_string(sizeof...(Args)) + " elements expected");
+      [&]<size_t... i>(std::index_sequence<i...>) {
+	(std::get<i>(parsers_).read(is, std::get<i>(t)), ...);
+      }(std::index_sequence_for<Args...>{});
+      if(head.indefinite() && ! readBreak(is))
+	throw internal::formatError("CBOR array of " + std::to_string(sizeof...(Args)) + " elements expected");
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, data_format>>
+      write(std::ostream& os, const Value& t) const {
+      internal::cbor::writeHead(os, internal::cbor::array, sizeof...(Args));
+      [&]<size_t... i>(std::index_sequence<i...>) {
+	(std::get<i>(parsers_).write(os, std::get<i>(t)), ...);
+      }(std::index_sequence_for<Args...>{});
+    }
+  };
+
+  /* Initial byte of CBOR flows (indefinite-length array) */
+  constexpr int CBOR_flow_start = (internal::cbor::array << 5) | internal::cbor::indefinite;
+
+  template<typename Format> class CBORParser<flow<Format>> : public CBORParserBase<flow<Format>> {
+    using typename ParserBase<gimlet::flow<Format>>::data_format;
+    using element_format = data_format_t<Format>;
+    CBORParser<element_format> elementParser_;
+    mutable bool finished_ = false;
+
+  public:
+    bool finished() const { return finished_; }
+
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value,data_format>>
+      read(std::istream& is, Value& val) const {
+      if(internal::cbor::readBreak(is)) finished_ = true;
+      else elementParser_.read(is, val);
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value,data_format>>
+      write(std::ostream& os, const Value& val) const {
+      elementParser_.write(os, val);
+    }
+
+    void readBegin(std::istream& is) const {
+      if(internal::cbor::getByte(is) != CBOR_flow_start)
+	throw internal::formatError("a CBOR flow starts as an indefinite-length array");
+    }
+
+    void readEnd(std::istream& is) const {
+      if(! finished_) {
+	finished_ = true;
+	if(! internal::cbor::readBreak(is)) throw internal::formatError("a CBOR flow ends with a break code");
+      }
+    }
+
+    void writeBegin(std::ostream& os) const {
+      os.put(static_cast<char>(CBOR_flow_start));
+    }
+
+    void writeEnd(std::ostream& os) const {
+      if(! finished_) {
+	finished_ = true;
+	os.put(static_cast<char>(internal::cbor::break_code));
+      }
+    }
+  };
+
+  template<typename Data>
+  CBORParser<data_format_t<Data>> make_CBOR_parser() {
+    return {};
+  }
+}
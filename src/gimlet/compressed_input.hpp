@@ -0,0 +1,43 @@
+#pragma once
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include <gimlet/thread_pool.hpp>
+
+namespace cool {
+
+  enum class Compression { none, gzip, zstd };
+
+  /* Compression of data recognized by the magic number of their first bytes */
+  Compression detectCompression(const char* data, size_t size);
+
+  /*
+   * Input stream over a file, or the standard input if the name is empty, which
+   * transparently decompresses gzip and zstd data as recognized by their magic
+   * numbers (concatenated members or frames included). Data are decompressed
+   * block by block straight into the buffer the stream is read from. Support of
+   * each format depends on the libraries found at build time: reading data of an
+   * unsupported format throws a std::runtime_error.
+   */
+  class InputFile : public std::istream {
+    std::unique_ptr<std::streambuf> buffer_;
+
+  public:
+    InputFile(const std::string& fileName);
+    ~InputFile();
+
+    Compression compression() const;
+  };
+
+  /*
+   * Decompresses zstd data in the seekable format, whose independent frames are
+   * indexed by a seek table in a final skippable frame, the frames being spread
+   * over the threads of pool. Returns false, with data unchanged, if the data are
+   * not seekable (or zstd is not supported).
+   */
+  bool decompressSeekable(const char* begin, const char* end, ThreadPool& pool, std::vector<char>& data);
+}
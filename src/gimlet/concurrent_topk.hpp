@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <iterator>
+#include <vector>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include <gimlet/topk_queue.hpp>
+
+namespace cool {
+
+  /**
+   * concurrent_topk
+   *
+   * Top-k collector shared by threads: every thread pushes into its own heap and
+   * publishes the k-th best score of this heap in an atomic threshold that only
+   * rises. The threshold is a lower bound of the global k-th best score, so that
+   * searches can prune against it without locking. purge() merges the heaps.
+   *
+   * T must provide score() and an operator< that is a total order consistent with
+   * ScoreCompare (e.g. score then pattern), so that ties are resolved the same way
+   * whatever the interleaving of threads.
+   *
+   * With Snapshots, every heap has its own lock, only contended when snapshot()
+   * copies the heaps while the search runs. Without, push() takes no lock.
+   */
+  template<typename T, typename ScoreCompare = std::less<std::decay_t<decltype(std::declval<T>().score())>>, bool Snapshots = false>
+  class concurrent_topk {
+  public:
+    using value_type = T;
+    using score_type = std::decay_t<decltype(std::declval<T>().score())>;
+
+  private:
+    struct alignas(64) UnlockedShard {
+      topk_queue<T> queue_;
+      std::thread::id owner_;
+      UnlockedShard(size_t K) : queue_(K), owner_(std::this_thread::get_id()) {}
+    };
+
+    struct alignas(64) LockedShard : UnlockedShard {
+      std::mutex mutex_;
+      LockedShard(size_t K) : UnlockedShard(K), mutex_() {}
+    };
+
+    using Shard = std::conditional_t<Snapshots, LockedShard, UnlockedShard>;
+
+    static unsigned long nextId() {
+      static std::atomic<unsigned long> counter{0};
+      return ++counter;
+    }
+
+    size_t K_;
+    unsigned long id_;
+    ScoreCompare comparator_;
+    std::atomic<score_type> threshold_;
+    std::atomic<bool> hasThreshold_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    /*
+     * Heap of the calling thread. Every thread caches the heaps of the last
+     * collectors it pushed into (ids are never reused); on a miss, the heap of
+     * the thread is looked up in the collector before creating one, so that a
+     * thread alternating between more collectors keeps a single heap in each.
+     */
+    Shard& local() {
+      thread_local std::array<std::pair<unsigned long, Shard*>, 4> cache{};
+      thread_local size_t next = 0;
+      for(auto& entry : cache)
+	if(entry.first == id_) return *entry.second;
+      Shard* shard = nullptr;
+      {
+	std::lock_guard<std::mutex> lock(mutex_);
+	const std::thread::id self = std::this_thread::get_id();
+	for(auto& candidate : shards_)
+	  if(candidate->owner_ == self) shard = candidate.get();
+	if(shard == nullptr) {
+	  shards_.emplace_back(new Shard{K_});
+	  shard = shards_.back().get();
+	}
+      }
+      cache[next++ % cache.size()] = { id_, shard };
+      return *shard;
+    }
+
+    void publish(const score_type& score) {
+      if(! hasThreshold_.load(std::memory_order_acquire)) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if(! hasThreshold_.load(std::memory_order_relaxed)) {
+	  threshold_.store(score, std::memory_order_relaxed);
+	  hasThreshold_.store(true, std::memory_order_release);
+	  return;
+	}
+      }
+      score_type current = threshold_.load(std::memory_order_relaxed);
+      while(comparator_(current, score) &&
+	    ! threshold_.compare_exchange_weak(current, score, std::memory_order_relaxed));
+    }
+
+  public:
+    concurrent_topk(size_t K, ScoreCompare comparator = ScoreCompare{}) :
+      K_(K), id_(nextId()), comparator_(comparator), threshold_{}, hasThreshold_{false}, mutex_{}, shards_{} {}
+    concurrent_topk(const concurrent_topk&) = delete;
+
+    size_t maxsize() const { return K_; }
+
+    /* True if a pattern whose score cannot exceed bound may still enter the top-k */
+    bool accepts(const score_type& bound) const {
+      return (! hasThreshold_.load(std::memory_order_acquire)) ||
+	comparator_(threshold_.load(std::memory_order_relaxed), bound);
+    }
+
+    void push(const T& value) {
+      Shard& shard = local();
+      if constexpr(Snapshots) {
+	score_type last;
+	{
+	  std::lock_guard<std::mutex> lock(shard.mutex_);
+	  shard.queue_.push(value);
+	  if(! shard.queue_.full()) return;
+	  last = shard.queue_.last().score();
+	}
+	// Published outside of the lock of the heap, snapshot() taking them in the other order
+	publish(last);
+      } else {
+	shard.queue_.push(value);
+	if(shard.queue_.full()) publish(shard.queue_.last().score());
+      }
+    }
+
+    /* Outputs the current top-k, best first, without removing it (may run during the search) */
+    template<typename OutputIt, typename Transform = cool::identity<T>>
+    OutputIt snapshot(OutputIt outIt, Transform f = Transform{}) {
+      static_assert(Snapshots, "snapshot() needs a collector built with Snapshots");
+      std::lock_guard<std::mutex> lock(mutex_);
+      topk_queue<T> merged(K_);
+      std::vector<T> entries;
+      for(auto& shard : shards_) {
+	entries.clear();
+	{
+	  std::lock_guard<std::mutex> shardLock(shard->mutex_);
+	  shard->queue_.copy(std::back_inserter(entries));
+	}
+	for(const T& entry : entries) merged.push(entry);
+      }
+      return merged.purge(outIt, f);
+    }
+
+    /* Merges the heaps of all threads and outputs the top-k, best first */
+    template<typename OutputIt, typename Transform = cool::identity<T>>
+    OutputIt purge(OutputIt outIt, Transform f = Transform{}) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      topk_queue<T> merged(K_);
+      for(auto& shard : shards_) {
+	std::vector<T> entries;
+	shard->queue_.purge(std::back_inserter(entries));
+	for(const T& entry : entries) merged.push(entry);
+      }
+      hasThreshold_.store(false);
+      return merged.purge(outIt, f);
+    }
+  };
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+#include <gimlet/itemsets.hpp>
+#include <gimlet/json_parser.hpp>
+#include <gimlet/cbor_parser.hpp>
+#include <gimlet/data_iterator.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    /*
+     * Names of the columns of a data set and, column by column, names of the values
+     * indexed by the codes they are encoded into. Data read as JSON have none.
+     */
+    struct Dictionary {
+      std::vector<std::string> names_;
+      std::vector<std::vector<std::string>> values_;
+
+      bool empty() const { return names_.empty(); }
+    };
+
+    /*
+     * Streaming reader of categorical data in CSV format. The first line holds the
+     * names of the columns, the delimiter being the most frequent of ',', ';', tab
+     * and '|' in it. Fields may be double quoted ("" standing for a quote inside), in
+     * which case they can span several lines. Every row is read as the list of the
+     * (column, code) pairs of all columns, the values of a column being coded by
+     * order of first appearance: an empty field is a value like any other.
+     */
+    class CSVReader {
+    public:
+      using value_type = wide_attribute_value_type;
+      using row_type = valued_row_type<value_type>;
+
+    private:
+      std::istream* is_;
+      char delimiter_;
+      size_t line_;
+      Dictionary dictionary_;
+      std::vector<std::unordered_map<std::string, value_type>> codes_;
+      std::string buffer_;
+      // Fields of the last record read are the nFields_ first ones (strings are reused)
+      std::vector<std::string> fields_;
+      size_t nFields_;
+
+      bool readLine();
+      void readRecord();
+
+    public:
+      /* Input iterator over the rows of a reader, the end being the default iterator */
+      class iterator {
+	CSVReader* reader_;
+	row_type row_;
+
+      public:
+	using iterator_category = std::input_iterator_tag;
+	using value_type = row_type;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const row_type*;
+	using reference = const row_type&;
+
+	iterator() : reader_(nullptr), row_() {}
+	iterator(CSVReader& reader) : reader_(&reader), row_() { ++(*this); }
+
+	iterator& operator++() {
+	  if(! reader_->read(row_)) reader_ = nullptr;
+	  return *this;
+	}
+	const row_type& operator*() const { return row_; }
+	const row_type* operator->() const { return &row_; }
+	bool operator==(const iterator& other) const { return reader_ == other.reader_; }
+	bool operator!=(const iterator& other) const { return reader_ != other.reader_; }
+      };
+
+      /* Reads the header of the data */
+      CSVReader(std::istream& is);
+
+      /* True if the data of is (leading spaces skipped) do not start as a JSON list */
+      static bool detect(std::istream& is);
+
+      /* Reads the next row, returns false at the end of the data */
+      bool read(row_type& row);
+
+      const Dictionary& dictionary() const { return dictionary_; }
+
+      iterator begin() { return iterator(*this); }
+      iterator end() { return iterator(); }
+    };
+
+    /*
+     * Calls process(begin, end) with input iterators over the (attribute, value)
+     * rows of is, read as a CBOR flow if is starts as an indefinite-length array, as
+     * CSV if CSVReader::detect(is) and as a JSON flow otherwise. The dictionary of
+     * CSV data is then given to dictionary.
+     */
+    template<typename Process>
+    void read_rows(std::istream& is, Process process, Dictionary& dictionary) {
+      using row_type = valued_row_type<wide_attribute_value_type>;
+      auto read_flow = [&] (auto parser) {
+	auto input_stream = gimlet::make_input_data_stream(is, parser);
+	process(gimlet::make_input_data_begin<decltype(input_stream), row_type>(input_stream),
+		gimlet::make_input_data_end<decltype(input_stream), row_type>(input_stream));
+	dictionary = Dictionary();
+      };
+      if(! CSVReader::detect(is))
+	read_flow(gimlet::make_JSON_parser<flow<row_type>>());
+      else if(is.peek() == CBOR_flow_start)
+	read_flow(gimlet::make_CBOR_parser<flow<row_type>>());
+      else {
+	CSVReader reader(is);
+	process(reader.begin(), reader.end());
+	dictionary = reader.dictionary();
+      }
+    }
+  }
+}
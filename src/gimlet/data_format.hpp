@@ -40,6 +40,7 @@
 #include <type_traits>
 
 #include <gimlet/type_traits.hpp>
+#include <gimlet/small_vector.hpp>
 
 namespace gimlet {
 
@@ -58,6 +59,7 @@ namespace gimlet {
   template<typename F> struct buffer {}; //! Intermediate buffer
   template<typename... Args> struct sequence {}; //! Sequence of heterogeneous elements
   template<typename F> struct flow {}; //! Flow of homogeneous elements
+  template<typename F> struct named {}; //! Index written as the name it refers to (see set_names)
 
   struct end_of_flow {};
   
@@ -145,6 +147,12 @@ namespace gimlet {
   template<typename D1, typename D2>
   struct is_more_specific<gimlet::list<D1>, std::vector<D2>> : std::integral_constant<bool, is_more_specific<D1, D2>::value> {};
 
+  template<typename D1, size_t N, typename D2>
+  struct is_more_specific<cool::small_vector<D1,N>, gimlet::list<D2>> : std::integral_constant<bool, is_more_specific<D1, D2>::value> {};
+
+  template<typename D1, typename D2, size_t N>
+  struct is_more_specific<gimlet::list<D1>, cool::small_vector<D2,N>> : std::integral_constant<bool, is_more_specific<D1, D2>::value> {};
+
   template<typename D1, typename D2>
   struct is_more_specific<std::list<D1>, gimlet::list<D2>> : std::integral_constant<bool, is_more_specific<D1, D2>::value> {};
 
@@ -235,6 +243,18 @@ namespace gimlet {
   template<typename D1, typename D2>
   struct is_more_specific<D1, flow<D2>> : std::integral_constant<bool, is_more_specific<D1, D2>::value> {};
 
+  /**
+     Named indices
+  */
+  template<typename D1, typename D2>
+  struct is_more_specific<named<D1>, D2> : std::integral_constant<bool, is_more_specific<D1, D2>::value> {};
+
+  template<typename D1, typename D2>
+  struct is_more_specific<D1, named<D2>> : std::integral_constant<bool, is_more_specific<D1, D2>::value> {};
+
+  template<typename D1, typename D2>
+  struct is_more_specific<named<D1>, named<D2>> : std::integral_constant<bool, is_more_specific<D1, D2>::value> {};
+
 
 
    /**
@@ -264,6 +284,9 @@ namespace gimlet {
   template<typename V, typename A> struct data_format<std::list<V,A>> {
     using type = gimlet::list<data_format_t<V>>;
   };
+  template<typename V, size_t N> struct data_format<cool::small_vector<V,N>> {
+    using type = gimlet::list<data_format_t<V>>;
+  };
   
   template<typename K, typename V> struct data_format<gimlet::map<K, V>> {
     using type = gimlet::map<data_format_t<K>, data_format_t<V>>;
@@ -386,6 +409,14 @@ namespace gimlet {
     }
   };
   
+  template<typename T>
+  struct data_format_traits<named<T>> {
+    using default_value_type = typename data_format_traits<T>::default_value_type;
+    static const std::string name() {
+      return std::string("named<") + data_format_traits<T>::name() + ">";
+    }
+  };
+
   template<typename T>
   struct data_format_traits<buffer<T>> {
     using default_value_type = typename data_format_traits<T>::default_value_type;
@@ -89,7 +89,7 @@ namespace gimlet {
 
   public:
     ostream_iterator() :
-      stream_(nullptr) {
+      stream_(nullptr), changed_(false) {
     }
     ostream_iterator(OutputDataStream& stream) :
       stream_(&stream), changed_(false) {
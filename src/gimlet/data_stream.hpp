@@ -26,6 +26,7 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <exception>
 
 //#include <gimlet/data_format_parser.hpp>
 
@@ -34,7 +35,7 @@ namespace gimlet {
   void initDataStreams();
 
   template<typename Parser> class InputDataStream : public Parser {
-    std::istream* is_;
+    std::istream* is_ = nullptr;
 
     void initInputStream() {
       initDataStreams();
@@ -63,8 +64,8 @@ namespace gimlet {
     }
     
     void close() {
-        if(is_)
-	  //        if(is_ && ! std::uncaught_exception())
+        // Not while unwinding from an error of the data, which readEnd would raise again
+        if(is_ && ! std::uncaught_exceptions())
           this->readEnd(*is_);
     }
 
@@ -112,7 +113,7 @@ namespace gimlet {
 
   template<typename Parser> class OutputDataStream : public Parser {
 
-    std::ostream* os_;
+    std::ostream* os_ = nullptr;
 
     void initOutputStream() {
       initDataStreams();
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include <gimlet/json_parser.hpp>
+#include <gimlet/bin_parser.hpp>
+#include <gimlet/cbor_parser.hpp>
+
+namespace gimlet {
+
+  enum class Encoding { json, binary, cbor };
+
+  /* Encoding of the data written by encoded parsers from now on (JSON by default) */
+  inline Encoding& output_encoding() {
+    static Encoding encoding = Encoding::json;
+    return encoding;
+  }
+
+  /* Encoding named "json", "bin" or "cbor" */
+  inline Encoding parse_encoding(const std::string& name) {
+    if(name == "json") return Encoding::json;
+    if(name == "bin") return Encoding::binary;
+    if(name == "cbor") return Encoding::cbor;
+    throw std::invalid_argument("Unknown output format \"" + name + "\" (json, bin or cbor expected)");
+  }
+
+  /*
+   * Parser delegating to the JSON, binary or CBOR parser of a format, the encoding
+   * being chosen at run time: data are written with the output encoding current
+   * when writing begins and read in the encoding recognized from their first byte
+   * (binary and CBOR flows cannot start JSON data).
+   */
+  template<typename Format> class EncodedParser : public ParserBase<Format> {
+    JSONParser<Format> jsonParser_;
+    BINParser<Format> binParser_;
+    CBORParser<Format> cborParser_;
+    mutable Encoding encoding_ = Encoding::json;
+
+    template<typename Action>
+    decltype(auto) dispatch(Action action) const {
+      switch(encoding_) {
+      case Encoding::binary: return action(binParser_);
+      case Encoding::cbor: return action(cborParser_);
+      default: return action(jsonParser_);
+      }
+    }
+
+  public:
+    bool finished() const {
+      return dispatch([] (const auto& parser) { return parser.finished(); });
+    }
+
+    template<typename Value>
+      void read(std::istream& is, Value& val) const {
+      dispatch([&] (const auto& parser) { parser.read(is, val); });
+    }
+
+    template<typename Value>
+      void write(std::ostream& os, const Value& val) const {
+      dispatch([&] (const auto& parser) { parser.write(os, val); });
+    }
+
+    void readBegin(std::istream& is) const {
+      is >> std::ws;
+      const int c = is.peek();
+      if(c == static_cast<unsigned char>(BIN_magic()[0])) encoding_ = Encoding::binary;
+      else if(c == CBOR_flow_start) encoding_ = Encoding::cbor;
+      else encoding_ = Encoding::json;
+      dispatch([&] (const auto& parser) { parser.readBegin(is); });
+    }
+
+    void readEnd(std::istream& is) const {
+      dispatch([&] (const auto& parser) { parser.readEnd(is); });
+    }
+
+    void writeBegin(std::ostream& os) const {
+      encoding_ = output_encoding();
+      dispatch([&] (const auto& parser) { parser.writeBegin(os); });
+    }
+
+    void writeEnd(std::ostream& os) const {
+      dispatch([&] (const auto& parser) { parser.writeEnd(os); });
+    }
+  };
+}
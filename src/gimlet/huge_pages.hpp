@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace cool {
+
+  /*
+   * Process-wide arena of large blocks backed by huge pages, so that big and
+   * randomly accessed arrays (FP-tree node blocks, partition cells) need few TLB
+   * entries. Memory is reserved by regions with mmap, using explicit 2MB pages
+   * when some are reserved and transparent huge pages (MADV_HUGEPAGE) otherwise.
+   * Blocks are rounded to powers of two (multiples of huge pages beyond) and
+   * recycled through per-size free lists; regions are never unmapped.
+   * allocate() returns nullptr when the arena is disabled, when the request is
+   * too small to benefit from huge pages or when no memory could be mapped: the
+   * caller then falls back to its usual allocator.
+   */
+  class HugePageArena {
+  public:
+    static constexpr size_t hugePageSize = size_t(2) << 20;
+    static constexpr size_t minBlockSize = size_t(256) << 10;
+    static constexpr size_t minRegionSize = size_t(64) << 20;
+
+  private:
+    std::atomic<bool> enabled_, used_;
+    std::mutex mutex_;
+    std::vector<std::pair<char*, size_t>> regions_;
+    char *next_, *end_;
+    std::map<size_t, std::vector<void*>> freeBlocks_;
+
+    HugePageArena();
+
+    static size_t blockSize(size_t bytes);
+    bool owns(const void* ptr) const;
+    bool map(size_t bytes);
+
+  public:
+    static HugePageArena& instance();
+
+    void enable(bool enabled = true) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    void* allocate(size_t bytes);
+    /* Gives back a block of the arena (returns false if ptr does not come from it) */
+    bool deallocate(void* ptr, size_t bytes);
+  };
+}
@@ -31,8 +31,12 @@
 #include <iterator>
 #include <random>
 #include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
 
 #include <gimlet/vector.hpp>
+#include <gimlet/small_vector.hpp>
 
 namespace gimlet {
 
@@ -44,10 +48,51 @@ namespace gimlet {
     using attribute_value_type = unsigned char;
     using valued_attribute_type = std::tuple<attribute_type, attribute_value_type>;
     using varset_type = std::vector<attribute_type>;
+    /* Patterns handled by miners are stored inline up to this number of attributes, on the heap beyond */
+    constexpr size_t inlinePatternSize = 255;
+    using pattern_varset_type = cool::small_vector<attribute_type, inlinePatternSize>;
     using valued_varset_type = std::vector<valued_attribute_type>;
     
     using index_type = unsigned int;
 
+    /* Type values are parsed into before being stored in the narrowest type holding them */
+    using wide_attribute_value_type = std::uint32_t;
+    template<typename Value>
+    using valued_row_type = std::vector<std::pair<attribute_type, Value>>;
+
+    template<typename Value, typename Row>
+    bool values_fit(const Row& row) {
+      for(const auto& pair : row)
+	if(pair.second > std::numeric_limits<Value>::max()) return false;
+      return true;
+    }
+
+    /*
+     * Stores the rows of (attribute, value) pairs of [it, end[ in a Store<Value>, Value
+     * being the narrowest of the 8, 16 and 32 bit unsigned types able to hold every value
+     * read, then calls process(store). Rows already stored are widened the first time a
+     * value does not fit, so that small value domains keep a compact representation.
+     * Store<Value> must provide push(row) and be constructible from a narrower store.
+     */
+    template<template<typename> class Store, typename Iterator, typename Process>
+    void store_with_narrowest_values(Iterator it, Iterator end, Process process) {
+      Store<std::uint8_t> store8;
+      for(; it != end && values_fit<std::uint8_t>(*it); ++it) store8.push(*it);
+      if(it == end) {
+	process(store8);
+	return;
+      }
+      Store<std::uint16_t> store16{std::move(store8)};
+      for(; it != end && values_fit<std::uint16_t>(*it); ++it) store16.push(*it);
+      if(it == end) {
+	process(store16);
+	return;
+      }
+      Store<std::uint32_t> store32{std::move(store16)};
+      for(; it != end; ++it) store32.push(*it);
+      process(store32);
+    }
+
     template<typename Pattern>
     typename Pattern::value_type first_free_item(const Pattern& pattern, typename Pattern::value_type item = 0) {
       for(auto it = pattern.end(); it != pattern.begin();) {
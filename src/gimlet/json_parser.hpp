@@ -145,6 +145,98 @@ namespace gimlet {
     }
   };
   
+  /* Double quoted strings, escaped characters other than \uXXXX being supported */
+  template<typename Char>
+  struct JSONParser<basic_string<Char>> : public JSONParserBase<basic_string<Char>> {
+    using typename ParserBase<basic_string<Char>>::data_format;
+
+    JSONParser(size_t tabs = 0) : JSONParserBase<basic_string<Char>>(tabs) {}
+
+    template<typename Value>
+      std::enable_if_t<is_read_compatible_v<Value, data_format>>
+      read(std::istream& is, Value& str) const {
+      str.clear();
+      internal::expectOneOf(is, "\"", "a string" " starts with" " a double quote");
+      int c;
+      while((c = is.get()) != '"') {
+	if(c == std::char_traits<char>::eof())
+	  throw internal::formatError(is, "a string" " ends with" " a double quote");
+	if(c == '\\') {
+	  switch(c = is.get()) {
+	  case 'b': c = '\b'; break;
+	  case 'f': c = '\f'; break;
+	  case 'n': c = '\n'; break;
+	  case 'r': c = '\r'; break;
+	  case 't': c = '\t'; break;
+	  case '"': case '\\': case '/': break;
+	  default: throw internal::formatError(is, "unsupported escape sequence in string");
+	  }
+	}
+	str.push_back(static_cast<typename Value::value_type>(c));
+      }
+    }
+
+    template<typename Value>
+      std::enable_if_t<is_write_compatible_v<Value, data_format>>
+      write(std::ostream& os, const Value& str) const {
+      static const char* hex = "0123456789abcdef";
+      os << '"';
+      for(auto c : str) {
+	switch(c) {
+	case '"': os << "\\\""; break;
+	case '\\': os << "\\\\"; break;
+	case '\n': os << "\\n"; break;
+	case '\r': os << "\\r"; break;
+	case '\t': os << "\\t"; break;
+	default:
+	  if(static_cast<unsigned char>(c) < 0x20)
+	    os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+	  else
+	    os << c;
+	}
+      }
+      os << '"';
+    }
+  };
+
+  // Slot of the output streams pointing to the names of named indices
+  inline int names_index() {
+    static const int index = std::ios_base::xalloc();
+    return index;
+  }
+
+  /*
+   * Attaches names to os so that an index i written with the named format is
+   * written as the string names[i] (nullptr detaches them). names must outlive
+   * the writes.
+   */
+  inline void set_names(std::ostream& os, const std::vector<std::string>* names) {
+    os.pword(names_index()) = const_cast<std::vector<std::string>*>(names);
+  }
+
+  /* Indices read as numbers and written as names when the stream has some (see set_names) */
+  template<typename Format>
+  struct JSONParser<named<Format>> : public JSONParserBase<named<Format>> {
+    JSONParser<Format> indexParser_;
+    JSONParser<gimlet::string> nameParser_;
+
+    JSONParser(size_t tabs = 0) : JSONParserBase<named<Format>>(tabs) {}
+
+    template<typename Value>
+      void read(std::istream& is, Value& index) const {
+      indexParser_.read(is, index);
+    }
+
+    template<typename Value>
+      void write(std::ostream& os, const Value& index) const {
+      const auto* names = static_cast<const std::vector<std::string>*>(os.pword(names_index()));
+      if(names && static_cast<size_t>(index) < names->size())
+	nameParser_.write(os, (*names)[index]);
+      else
+	indexParser_.write(os, index);
+    }
+  };
+
   template<typename Format>
   struct JSONParser<list<Format>> : JSONParserBase<list<Format>> {
     using typename ParserBase<list<Format>>::data_format;
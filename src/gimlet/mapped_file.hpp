@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace cool {
+
+  /*
+   * Read-only memory mapping of a whole file, unmapped with the object. The
+   * mapping is advised for sequential access.
+   */
+  class MappedFile {
+    const char* data_;
+    size_t size_;
+
+  public:
+    MappedFile(const std::string& fileName);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+  };
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string>
+
+#include <gimlet/statistics.hpp>
+#include <gimlet/huge_pages.hpp>
+
+namespace cool {
+
+  /*
+   * Process-wide accounting of the bytes held by the main data structures of the
+   * miners, subsystem by subsystem. A soft limit on the total lets searches trade
+   * time for memory when they get close to it (see nearLimit()): it never makes an
+   * allocation fail.
+   */
+  class MemoryBudget {
+  public:
+    enum Subsystem { treeNodes, treeParts, partitionCells, partitionParts, nSubsystems };
+
+  private:
+    std::atomic<size_t> used_[nSubsystems], peak_[nSubsystems], total_;
+    size_t limit_;
+
+    MemoryBudget();
+
+  public:
+    static MemoryBudget& instance();
+    static const char* name(Subsystem subsystem);
+
+    /* Sets the limit in bytes (0 for no limit) */
+    void setLimit(size_t limit) { limit_ = limit; }
+    size_t limit() const { return limit_; }
+
+    void allocate(Subsystem subsystem, size_t bytes) {
+      size_t used = used_[subsystem].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+      size_t peak = peak_[subsystem].load(std::memory_order_relaxed);
+      while(peak < used && ! peak_[subsystem].compare_exchange_weak(peak, used, std::memory_order_relaxed));
+      total_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    void deallocate(Subsystem subsystem, size_t bytes) {
+      used_[subsystem].fetch_sub(bytes, std::memory_order_relaxed);
+      total_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    size_t used() const { return total_.load(std::memory_order_relaxed); }
+    size_t used(Subsystem subsystem) const { return used_[subsystem].load(std::memory_order_relaxed); }
+    size_t peak(Subsystem subsystem) const { return peak_[subsystem].load(std::memory_order_relaxed); }
+
+    /* True if allocating bytes more would use more than the given fraction of the limit */
+    bool nearLimit(size_t bytes = 0, double fraction = 0.9) const {
+      return limit_ != 0 && static_cast<double>(used() + bytes) > fraction * static_cast<double>(limit_);
+    }
+
+    /* Reports the peak usage of subsystem (in MB) when stats are written */
+    void addStatistics(Statistics& stats, Subsystem subsystem) const;
+  };
+
+  /*
+   * Parses a memory size given in bytes or with a K, M or G suffix (e.g. "512M").
+   */
+  size_t parseMemorySize(const std::string& size);
+
+  /*
+   * Standard allocator accounting its memory in a subsystem of the budget.
+   * Large arrays are taken from the huge page arena when it is enabled.
+   */
+  template<typename T, MemoryBudget::Subsystem S>
+  struct CountingAllocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = CountingAllocator<U, S>; };
+
+    CountingAllocator() = default;
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U, S>&) {}
+
+    T* allocate(size_t n) {
+      T* ptr = static_cast<T*>(HugePageArena::instance().allocate(n * sizeof(T)));
+      if(! ptr) ptr = std::allocator<T>{}.allocate(n);
+      MemoryBudget::instance().allocate(S, n * sizeof(T));
+      return ptr;
+    }
+    void deallocate(T* ptr, size_t n) {
+      MemoryBudget::instance().deallocate(S, n * sizeof(T));
+      if(! HugePageArena::instance().deallocate(ptr, n * sizeof(T)))
+	std::allocator<T>{}.deallocate(ptr, n);
+    }
+
+    template<typename U>
+    bool operator==(const CountingAllocator<U, S>&) const { return true; }
+    template<typename U>
+    bool operator!=(const CountingAllocator<U, S>&) const { return false; }
+  };
+
+  /*
+   * Model of the UserAllocator concept of Boost.Pool accounting its blocks in a
+   * subsystem of the budget, large blocks coming from the huge page arena when it
+   * is enabled. Block sizes are kept in a header since free() does not receive them.
+   */
+  template<MemoryBudget::Subsystem S>
+  struct CountingUserAllocator {
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    static constexpr size_type headerSize = alignof(std::max_align_t);
+
+    static char* malloc(const size_type bytes) {
+      char* block = static_cast<char*>(HugePageArena::instance().allocate(headerSize + bytes));
+      if(! block) block = static_cast<char*>(::operator new(headerSize + bytes, std::nothrow));
+      if(! block) return nullptr;
+      *reinterpret_cast<size_type*>(block) = bytes;
+      MemoryBudget::instance().allocate(S, headerSize + bytes);
+      return block + headerSize;
+    }
+    static void free(char* const ptr) {
+      char* block = ptr - headerSize;
+      const size_type bytes = headerSize + *reinterpret_cast<size_type*>(block);
+      MemoryBudget::instance().deallocate(S, bytes);
+      if(! HugePageArena::instance().deallocate(block, bytes))
+	::operator delete(block);
+    }
+  };
+}
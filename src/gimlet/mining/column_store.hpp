@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace gimlet {
+  namespace itemsets {
+
+    /*
+     * Disk-backed store of the columns of a data set. Every column is kept as the
+     * array of the part labels of its rows in a memory-mapped file, so that the
+     * kernel pages columns in and out instead of holding all of them in RAM.
+     * Labels take 1, 2 or 4 bytes according to the number of parts of the column.
+     * The file is created in a given directory and unlinked at once: it disappears
+     * with the store.
+     */
+    class ColumnStore {
+    public:
+      using size_type = unsigned int;
+      using field_t = unsigned short;
+
+    private:
+      struct Column {
+	size_t offset_;
+	unsigned char width_;
+	size_type nParts_;
+      };
+
+      std::string directory_;
+      int fd_;
+      char* data_;
+      size_t size_, nRows_;
+      std::vector<Column> columns_;
+
+      void unmap();
+
+    public:
+      ColumnStore(const std::string& directory);
+      ColumnStore(const ColumnStore&) = delete;
+      ColumnStore& operator=(const ColumnStore&) = delete;
+      ~ColumnStore();
+
+      /* Maps a file holding nRows labels per column, columns having nParts[field] parts (0 for no column) */
+      void allocate(size_t nRows, const std::vector<size_type>& nParts);
+
+      void set(field_t field, size_t row, size_type label) {
+	const Column& column = columns_[field];
+	char* labels = data_ + column.offset_;
+	switch(column.width_) {
+	case 1: reinterpret_cast<std::uint8_t*>(labels)[row] = static_cast<std::uint8_t>(label); break;
+	case 2: reinterpret_cast<std::uint16_t*>(labels)[row] = static_cast<std::uint16_t>(label); break;
+	default: reinterpret_cast<std::uint32_t*>(labels)[row] = label;
+	}
+      }
+
+      /* Calls func(label) for the rows of a column in order */
+      template<typename Function>
+      void apply(field_t field, Function func) const {
+	const Column& column = columns_[field];
+	const char* labels = data_ + column.offset_;
+	switch(column.width_) {
+	case 1: for(size_t row = 0; row != nRows_; ++row) func(reinterpret_cast<const std::uint8_t*>(labels)[row]); break;
+	case 2: for(size_t row = 0; row != nRows_; ++row) func(reinterpret_cast<const std::uint16_t*>(labels)[row]); break;
+	default: for(size_t row = 0; row != nRows_; ++row) func(reinterpret_cast<const std::uint32_t*>(labels)[row]);
+	}
+      }
+
+      /* Forgets a column: it is reported as empty from now on */
+      void drop(field_t field) { columns_[field].nParts_ = 0; }
+
+      size_t nRows() const { return nRows_; }
+      size_t nColumns() const { return columns_.size(); }
+      size_type nParts(field_t field) const { return field < columns_.size() ? columns_[field].nParts_ : 0; }
+    };
+  }
+}
@@ -4,17 +4,26 @@
 #include <vector>
 #include <iostream>
 #include <cassert>
+#include <memory>
 #include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <string>
+
+#include <boost/functional/hash.hpp>
 
 #include <gimlet/vector.hpp>
+#include <gimlet/memory_budget.hpp>
+#include <gimlet/thread_pool.hpp>
+#include <gimlet/csv_reader.hpp>
 #include <gimlet/mining/scoring_functions.hpp>
+#include <gimlet/mining/column_store.hpp>
 
 
 namespace gimlet {
   namespace itemsets {
 
-    using value_field_t = unsigned char;
-
     class Partition {
     public:
       using size_type = unsigned int;
@@ -36,11 +45,16 @@ namespace gimlet {
 	size_type n_;
 
 	Part() = default;
-	void add(Cell* cell);
+	void add(Cell* cell, size_type weight = 1);
 	bool empty();
       };
 
-      static Part* addPart(std::vector<Part>& parts);
+      using cell_allocator_t = cool::CountingAllocator<Cell, cool::MemoryBudget::partitionCells>;
+      using part_allocator_t = cool::CountingAllocator<Part, cool::MemoryBudget::partitionParts>;
+      using cells_t = std::vector<Cell, cell_allocator_t>;
+      using parts_t = std::vector<Part, part_allocator_t>;
+
+      static Part* addPart(parts_t& parts);
       
       size_type getIndex(const Cell* cell) const;      
       Cell* getPtr(size_type index) const;
@@ -65,15 +79,19 @@ namespace gimlet {
 	Rebuilder(const Rebuilder&) = default;
 	Rebuilder& operator=(const Rebuilder&) = default;
 	
-	void operator()(std::vector<Cell>& cells, Cell* oldAddr);
-	void operator()(std::vector<Part>& parts, Part* oldAddr);
+	void operator()(cells_t& cells, Cell* oldAddr);
+	void operator()(parts_t& parts, Part* oldAddr);
       };
 
       Rebuilder rebuilder_;
       Cell *base_, *end_;
-      cool::vector<Cell, Rebuilder> cells_;
-      cool::vector<Part, Rebuilder> parts_;
+      // Multiplicity of every cell when identical rows are merged (nullptr if none is)
+      std::shared_ptr<const std::vector<size_type>> weights_;
+      cool::vector<Cell, Rebuilder, cell_allocator_t> cells_;
+      cool::vector<Part, Rebuilder, part_allocator_t> parts_;
       size_type nEmptyParts_;
+
+      size_type weight(const Cell* cell) const { return weights_ ? (*weights_)[getIndex(cell)] : 1; }
       
     public:
       Partition();
@@ -84,6 +102,7 @@ namespace gimlet {
 
       bool empty() const;
       size_t size() const;
+      size_t nRows() const;
       size_t nParts() const;
       size_t nNonEmptyParts() const;
       size_t nEmptyParts() const;
@@ -100,36 +119,43 @@ namespace gimlet {
       void apply(Function func) const;
 
       double entropy() const;
+      std::vector<size_type> labels() const;
 
       void printArray(std::ostream& os) const;
       void printList(std::ostream& os) const;
       void printPartSize(std::ostream& os) const;
       friend std::ostream& operator<<(std::ostream& os, const Partition& column);
 
-      struct Mapper : std::unordered_map<value_field_t, Part*> {
+      friend struct Partitions;
+
+      /*
+       * Adds cells to a partition, the part of every cell being given by its value.
+       * Parts are mapped by index as parts_ moves when it grows.
+       */
+      template<typename Value>
+      struct Mapper : std::unordered_map<Value, size_type> {
 	Partition* partition_;
 
 	Mapper(Partition& partition);
 
-	void setPartition(Partition& partition);	
-	void addCell(value_field_t value);
+	void addCell(Value value, size_type weight = 1);
       };      
     };
 
-    template<typename Score = NoScore<Partition>>
+    template<typename Score>
     Score Partition::intersect(const Partition& other, Score score) const {
       Partition copy = *this;
       return copy.intersect(other, score);
     }    
 
-    template<typename Score = NoScore<Partition>>
+    template<typename Score>
     Score Partition::intersect(const Partition& other, Score score) {
       assert(size() == other.size());
 
       score.begin(this->nParts(), other.nParts());
       
       size_type nParts = this->nParts() * other.nParts();
-      std::vector<Part> parts;
+      parts_t parts;
       parts.reserve(std::min(size(), parts_.size() * other.parts_.size()));
 
       for(Part& part : parts_) {
@@ -143,7 +169,7 @@ namespace gimlet {
 	    newPart = addPart(parts);
 	    otherPart->newPart_ = newPart;
 	  }
-	  newPart->add(cell);
+	  newPart->add(cell, weight(cell));
 	  cell = next;
 	}
 	  
@@ -185,43 +211,72 @@ namespace gimlet {
       using size_type = Partition::size_type;
       using field_t = unsigned short;
       using column_t = Partition;
+      /* Predicate selecting the rows to load (see load()) */
+      using row_filter_t = std::function<bool(const valued_row_type<wide_attribute_value_type>&)>;
       
     private:
-      using mapper_t = Partition::Mapper;
-      
-      struct Rebuilder {
-	Partitions* partitions_;
-	Rebuilder(Partitions& partitions);
-	Rebuilder(const Rebuilder&) = default;
-	Rebuilder& operator=(const Rebuilder&) = default;
+      /* Distinct rows with their number of occurrences, in order of first occurrence */
+      template<typename Value>
+      struct RowSet {
+	using row_t = std::vector<std::pair<field_t, Value>>;
 	
-	void operator()(std::vector<Partition>& partitions, Partition* oldAddr);
+	std::unordered_map<row_t, size_type, boost::hash<row_t>> indices_;
+	std::vector<const row_t*> rows_;
+	std::vector<size_type> weights_;
+	size_t size_ = 0;
+
+	RowSet() = default;
+	template<typename Narrower>
+	RowSet(RowSet<Narrower>&& other);
+
+	template<typename Row>
+	void push(const Row& row);
+	/* Appends the rows of other as if they were pushed after those of this set */
+	void merge(RowSet&& other);
       };
 
-      Rebuilder rebuilder_;
+      /* Rows of a chunk of JSON data parsed by a thread of a parallel load */
+      struct ParsedChunk;
+      
       Partition top_;
-      cool::vector<Partition, Rebuilder> columns_;
-      std::vector<mapper_t> mappers_;
-      mapper_t topMapper_;
+      // Columns are allocated one by one so that they never move (mappers and rebuilders point to them)
+      mutable std::vector<std::unique_ptr<Partition>> columns_;
       size_t size_;
-
-      class Iterator : public std::vector<Partition>::iterator {
-	using parent_iterator = std::vector<Partition>::iterator;
-	parent_iterator end_;
-	field_t index_;
+      std::shared_ptr<const std::vector<size_type>> weights_;
+      Dictionary dictionary_;
+      // Out-of-core mode: columns live in the store and at most nResident_ of them are materialized,
+      // the most recently used first
+      std::unique_ptr<ColumnStore> store_;
+      size_t nResident_;
+      mutable std::list<field_t> resident_;
+
+      class Iterator {
+	Partitions* partitions_;
+	field_t index_, end_;
 	size_type n_;
 
 	void update();
       public:
 	Iterator() = default;
-	Iterator(const parent_iterator& it, const parent_iterator& end, field_t index);
-	Iterator(const Iterator& other);
+	Iterator(Partitions& partitions, field_t index, field_t end);
+	Iterator(const Iterator& other) = default;
 
 	Iterator& operator++();
+	Partition& operator*() const;
+	Partition* operator->() const;
+	bool operator==(const Iterator& other) const { return index_ == other.index_; }
+	bool operator!=(const Iterator& other) const { return index_ != other.index_; }
 	field_t index();
       };
 
-      template<typename _Pattern> void add(const _Pattern& pattern);
+      bool absent(field_t field) const;
+      size_t columnSize(field_t field) const;
+      Partition& column(field_t field) const;
+      template<typename Value> void build(const RowSet<Value>& rows, cool::ThreadPool* pool = nullptr);
+      template<typename Value> void load(std::vector<ParsedChunk>& chunks, cool::ThreadPool& pool);
+      bool load(const char* begin, const char* end, size_t nThreads, cool::ThreadPool* pool);
+      template<typename Value> void store(const RowSet<Value>& rows, field_t nColumns);
+      void setWeights(std::shared_ptr<const std::vector<size_type>> weights);
       
     public:
       using iterator = Iterator;
@@ -229,27 +284,81 @@ namespace gimlet {
       iterator begin();
       iterator end();
 
-      mapper_t& getMapper(field_t field);
-
       Partition& operator[] (field_t field);
       const Partition& operator[] (field_t field) const;
       Partitions();
 
+      /*
+       * Keeps the columns loaded from now on in a memory-mapped file of directory, at
+       * most nResident of them (and at least 2) being materialized at once. References
+       * to a column stay valid until nResident - 1 other columns are accessed.
+       */
+      void setColumnStore(const std::string& directory, size_t nResident);
+      /* Takes a column out of the data set, which then skips it */
+      Partition remove(field_t field);
+
+      /* Loads JSON or CSV data (see read_rows) */
       void load(std::istream& is);
+      /* Only loads the rows for which keep returns true (called once per row, in order) */
+      void load(std::istream& is, const row_filter_t& keep);
+      /*
+       * Loads a file with nThreads threads when it holds JSON data: the mapped file
+       * is split between rows, chunks are parsed in parallel and merged in row order,
+       * then columns are built in parallel. Seekable zstd files are first decompressed
+       * in parallel, other compressed files and the standard input (empty name) are
+       * read as streams (see cool::InputFile). The result is the same as load(is).
+       */
+      void load(const std::string& fileName, size_t nThreads);
+      /* Names of the columns and of their values (empty unless the data were CSV) */
+      const Dictionary& dictionary() const;
       const column_t& top() const;
       size_t size();
 
       friend std::ostream& operator<<(std::ostream& os, const Partitions& columns);
     };
 
-    template<typename _Pattern>
-    void Partitions::add(const _Pattern& pattern) {
-      for(const auto& pair : pattern) {
-	mapper_t& mapper = getMapper(pair.first);
-	mapper.addCell(pair.second);
+    template<typename Value>
+    template<typename Narrower>
+    Partitions::RowSet<Value>::RowSet(RowSet<Narrower>&& other) : indices_(), rows_(), weights_(std::move(other.weights_)), size_(other.size_) {
+      indices_.reserve(other.indices_.size());
+      rows_.resize(other.rows_.size());
+      for(auto& [row, index] : other.indices_) {
+	auto it = indices_.emplace(row_t(row.begin(), row.end()), index).first;
+	rows_[index] = &it->first;
       }
-      topMapper_.addCell(1);
+      other.indices_.clear();
+      other.rows_.clear();
+    }
+
+    template<typename Value>
+    void Partitions::RowSet<Value>::merge(RowSet&& other) {
+      for(size_type index = 0; index != other.rows_.size(); ++index) {
+	// Rows are moved from a set to the other without being copied
+	auto [it, inserted, node] = indices_.insert(other.indices_.extract(*other.rows_[index]));
+	if(inserted) {
+	  it->second = static_cast<size_type>(rows_.size());
+	  rows_.push_back(&it->first);
+	  weights_.push_back(other.weights_[index]);
+	} else
+	  weights_[it->second] += other.weights_[index];
+      }
+      size_ += other.size_;
+      other = RowSet();
+    }
+
+    // Identical rows are merged into a single row weighted by their number of occurrences
+    template<typename Value>
+    template<typename Row>
+    void Partitions::RowSet<Value>::push(const Row& row) {
+      row_t sorted(row.begin(), row.end());
+      std::sort(sorted.begin(), sorted.end());
+      auto [it, inserted] = indices_.try_emplace(std::move(sorted), static_cast<size_type>(rows_.size()));
+      if(inserted) {
+	rows_.push_back(&it->first);
+	weights_.push_back(1);
+      } else
+	++weights_[it->second];
+      ++size_;
     }
-    
   }
 }
@@ -30,6 +30,9 @@
 #include <cmath>
 #include <cassert>
 #include <algorithm>
+#include <map>
+#include <array>
+#include <tuple>
 
 #include <gimlet/itemsets.hpp>
 #include <gimlet/statistics.hpp>
@@ -54,6 +57,9 @@ namespace gimlet {
       void update(size_type) {}
       void subend() {}
       void end() {}
+      void extend(const Partition&) {}
+      /* Smallest number of values of the attributes that can extend the patterns (at least 2) */
+      void setMinValues(size_t) {}
 
       value_t min();
       value_t max();
@@ -178,6 +184,8 @@ namespace gimlet {
     public:
       SEntropy() = default;
       SEntropy(double alpha, long nParts) : alpha_(alpha), counts_(0.), sumxlogx_(0.), nParts_(nParts), nNonEmptyParts_(0) {}
+      SEntropy(double alpha, long nParts, double counts, double sumxlogx, long nNonEmptyParts) :
+	alpha_(alpha), counts_(counts), sumxlogx_(sumxlogx), nParts_(nParts), nNonEmptyParts_(nNonEmptyParts) {}
       SEntropy(const SEntropy&) = default;
       
       void setNParts(long nParts) { nParts_ = nParts; }
@@ -244,6 +252,8 @@ namespace gimlet {
     public:
       SCondEntropy() = default;
       SCondEntropy(double alpha, long nXParts, long nYParts) : alpha_(alpha), counts_(0.), sumxlogx_(0.), sumxylogxy_(0.), nXParts_(nXParts), nYParts_(nYParts), nNonEmptyXParts_(0) {}
+      SCondEntropy(double alpha, long nXParts, long nYParts, double counts, double sumxlogx, double sumxylogxy, long nNonEmptyXParts) :
+	alpha_(alpha), counts_(counts), sumxlogx_(sumxlogx), sumxylogxy_(sumxylogxy), nXParts_(nXParts), nYParts_(nYParts), nNonEmptyXParts_(nNonEmptyXParts) {}
       SCondEntropy(const SCondEntropy&) = default;
 
       SCondEntropy& operator+=(const SEntropy& other) {
@@ -346,7 +356,8 @@ namespace gimlet {
 	return v1 < v2;
       }
 
-      SmoothedInformation(double alpha = 1) : alpha_(alpha), aloga_(xlogx(alpha)), partitionY_(), HXa_(), HYx_(), HYgX_() {}
+      SmoothedInformation(double alpha = 1) :
+	alpha_(alpha), aloga_(xlogx(alpha)), n_(0.), IXY_(0.), bound_(0.), partitionY_(), HXa_(), HYx_(), HYgX_(), NX_(0), NY_(0) {}
       SmoothedInformation(const SmoothedInformation&) = default;
 
       void setTarget(const Partition& target) {
@@ -374,6 +385,13 @@ namespace gimlet {
 	HYgX_ += HYx_;
       }
 
+      // Ends with entropies accumulated outside of this scorer (see SmoothedInformationSweep)
+      void end(const SEntropy& HXa, const SCondEntropy& HYgX) {
+	HXa_ = HXa;
+	HYgX_ = HYgX;
+	end();
+      }
+      
       void end() {	
 	n_ = HYgX_.counts();
 	double HY = computeSmoothedEntropyOfY(alpha_ *  NX_);
@@ -492,6 +510,114 @@ namespace gimlet {
     };
 
 
+    /*
+     * Smoothed information for several values of alpha computed with a single intersection.
+     * Entropy accumulators are stored as one lane per alpha in contiguous arrays, the final
+     * scores and bounds being delegated to one SmoothedInformation per lane.
+     * Lanes are updated one after the other: xlogx branches and std::log2 may set errno, so
+     * that the compiler keeps these loops scalar. The sweep saves the tree and the
+     * intersections of the separate runs, not their logarithms.
+     */
+    template<typename Partition, bool active_bound1, bool active_bound2>
+    class SmoothedInformationSweep : public PartitionScore<Partition, std::vector<double>> {
+      using size_type = typename Partition::size_type;
+      using lane_t = SmoothedInformation<Partition, active_bound1, active_bound2>;
+
+      std::vector<double> alphas_, alogas_;
+      std::vector<lane_t> lanes_;
+      const Partition *partitionY_;
+      size_type NX_, NY_;
+      double nx_, n_;
+      long nNonEmptyYParts_, nNonEmptyXParts_;
+      std::vector<double> HYx_, HXa_, HYgX_, HYgXxy_;
+      std::vector<double> scores_, bounds_;
+      
+    public:
+      using value_t = std::vector<double>;
+      
+      static bool comparator(double v1, double v2) {
+	return v1 < v2;
+      }
+
+      SmoothedInformationSweep(const std::vector<double>& alphas) :
+	alphas_(alphas), alogas_(), lanes_(), partitionY_(),
+	HYx_(alphas.size()), HXa_(alphas.size()), HYgX_(alphas.size()), HYgXxy_(alphas.size()),
+	scores_(alphas.size()), bounds_(alphas.size()) {
+	for(double alpha : alphas_) {
+	  alogas_.push_back(xlogx(alpha));
+	  lanes_.emplace_back(alpha);
+	}
+      }
+      SmoothedInformationSweep(const SmoothedInformationSweep&) = default;
+
+      size_t lanes() const { return alphas_.size(); }
+      
+      void setTarget(const Partition& target) {
+	partitionY_ = &target;
+	NY_ = target.nParts();
+	for(lane_t& lane : lanes_)
+	  lane.setTarget(target);
+      }
+
+      void begin(size_type NX, size_type NY) {
+	NX_ = NX;
+	n_ = 0.;
+	nNonEmptyXParts_ = 0;
+	std::fill(HXa_.begin(), HXa_.end(), 0.);
+	std::fill(HYgX_.begin(), HYgX_.end(), 0.);
+	std::fill(HYgXxy_.begin(), HYgXxy_.end(), 0.);
+      }
+      
+      void subbegin() {
+	nx_ = 0.;
+	nNonEmptyYParts_ = 0;
+	std::fill(HYx_.begin(), HYx_.end(), 0.);
+      }
+      
+      void update(double count) {
+	nx_ += count;
+	++nNonEmptyYParts_;
+	const size_t nLanes = alphas_.size();
+	const double* alphas = alphas_.data();
+	double* HYx = HYx_.data();
+	for(size_t lane = 0; lane != nLanes; ++lane)
+	  HYx[lane] += xlogx(count + alphas[lane]);
+      }
+
+      void subend() {
+	const size_t nLanes = alphas_.size();
+	const double nEmptyYParts = NY_ - nNonEmptyYParts_;
+	for(size_t lane = 0; lane != nLanes; ++lane) {
+	  double alpha = alphas_[lane];
+	  double HYx = HYx_[lane] + nEmptyYParts * alogas_[lane];
+	  HXa_[lane] += xlogx(nx_ + alpha);
+	  HYgX_[lane] += xlogx(nx_ + NY_ * alpha);
+	  HYgXxy_[lane] += HYx;
+	}
+	n_ += nx_;
+	++nNonEmptyXParts_;
+      }
+
+      void end() {
+	for(size_t lane = 0; lane != lanes_.size(); ++lane) {
+	  double alpha = alphas_[lane];
+	  lane_t& scorer = lanes_[lane];
+	  scorer.begin(NX_, NY_);
+	  scorer.end(SEntropy{alpha, long(NX_), n_, HXa_[lane], nNonEmptyXParts_},
+		     SCondEntropy{alpha, long(NX_), long(NY_), n_, HYgX_[lane], HYgXxy_[lane], nNonEmptyXParts_});
+	  std::tie(scores_[lane], bounds_[lane]) = static_cast<std::pair<double, double>>(scorer);
+	}
+      }
+      
+      SmoothedInformationSweep operator()(const Partition& partitionX) const {
+	return partitionX.intersect(*partitionY_, *this);
+      }
+
+      operator std::pair<value_t, value_t>() const {
+	return { scores_, bounds_ };
+      }
+    };
+
     template<typename Partition>
     class ReliableFractionOfInformation : public PartitionScore<Partition, double> {
       using size_type = typename Partition::size_type;
@@ -628,11 +754,24 @@ namespace gimlet {
     class AdjustedDependency : public PartitionScore<Partition, double> {
       using size_type = typename Partition::size_type;
 
-      double HX_, HY_, HXY_, alpha_;
-      unsigned long nx_, n_;
+      double HX_, HY_, HXY_, HYx_, alpha_;
+      unsigned long NY_, nx_, n_;
       unsigned long dOfFreedom_;
       double adjustedDependency_, bound_;
       const Partition *partitionY_;
+      bool tightBound_;
+      double growth_;
+      std::vector<double> gains_;
+
+      /* The search of a critical value is linear in the degrees of freedom and the
+	 bound needs several per pattern, out of few distinct ones: they are cached */
+      double bias(unsigned long dOfFreedom) const {
+	thread_local std::map<std::pair<double, unsigned long>, double> criticalValues;
+	auto it = criticalValues.find({alpha_, dOfFreedom});
+	if(it == criticalValues.end())
+	  it = criticalValues.emplace(std::make_pair(alpha_, dOfFreedom), stats::chiTestCriticalValue(alpha_, dOfFreedom)).first;
+	return it->second / (2. * n_);
+      }
             
     public:
       using value_t = double;
@@ -641,7 +780,9 @@ namespace gimlet {
 	return v1 < v2;
       }
 
-      AdjustedDependency(double alpha) : alpha_(alpha) {};
+      AdjustedDependency(double alpha, bool tightBound = true) :
+	HX_(0.), HY_(0.), HXY_(0.), HYx_(0.), alpha_(alpha), NY_(0), nx_(0), n_(0), dOfFreedom_(0),
+	adjustedDependency_(0.), bound_(0.), partitionY_(nullptr), tightBound_(tightBound), growth_(0.), gains_() {};
       AdjustedDependency(const AdjustedDependency&) = default;
       
       void setTarget(const Partition& target) {
@@ -649,27 +790,44 @@ namespace gimlet {
 	Entropy H = Entropy<Partition>{}(*partitionY_);
 	HY_ = H;
 	n_ = H.count();
-	unsigned long NY = target.nParts();
-	dOfFreedom_ = NY - 1;
+	NY_ = target.nParts();
+	dOfFreedom_ = NY_ - 1;
+	if(tightBound_) gains_.resize(NY_ + 1);
 	// std::cerr << "SET DOF = " << dOfFreedom_ << std::endl;	
       }
 
+      /* An attribute with m >= minValues values multiplies the degrees of freedom by
+	 m - 1 >= m^growth_: splitting the parts m-fold multiplies them at least by m^growth_ */
+      void setMinValues(size_t minValues) {
+	growth_ = minValues > 2 ? std::log(minValues - 1.) / std::log(double(minValues)) : 0.;
+      }
+
       void begin(size_type NX, size_type NY) {
 	HX_ = HXY_ = 0;
+	std::fill(gains_.begin(), gains_.end(), 0.);
 	// std::cerr << "UPDATE DOF " << NX << " -> " << dOfFreedom_ << std::endl;
       }
       
       void subbegin() {
 	nx_ = 0.;
+	HYx_ = 0.;
       }
       
       void update(double nxy) {
 	HXY_ += xlogx(nxy);
+	HYx_ += xlogx(nxy);
 	nx_ += nxy;
       }
 
+      /* gains_[m] accumulates nx * min(H(Y|x), log2 m): the largest information gain
+	 that splitting every part of X into m subparts can bring. */
       void subend() {
 	HX_ += xlogx(nx_);
+	if(tightBound_ && nx_ > 0) {
+	  double HYx = std::log2(nx_) - HYx_ / nx_;
+	  for(size_t m = 2; m < gains_.size(); ++m)
+	    gains_[m] += nx_ * std::min(HYx, std::log2(m));
+	}
       }
       
       void end() {
@@ -677,18 +835,38 @@ namespace gimlet {
 	HX_ = logn - HX_ / n_;
 	HXY_ = logn - HXY_ / n_;
 	double info = (HY_ + HX_ - HXY_);
-	double bias = stats::chiTestCriticalValue(alpha_, dOfFreedom_)/ (2. * n_);
+	double bias = this->bias(dOfFreedom_);
 	adjustedDependency_ = (info - bias) / HY_;
-	bound_ = 1. - bias;	
+	/* A specialization splitting the parts of X m-fold gains at most gains_[m] / n while
+	   its degrees of freedom are at least dOfFreedom_ * m^growth_. Beyond m = NY, the gain
+	   is maximal while the bias keeps growing. With binary attributes (growth_ = 0), the
+	   bias does not grow and the bound is 1 - bias / H(Y). The median of a chi-square with
+	   k degrees of freedom exceeds k - 2/3: when alpha <= 0.5, it spares the critical
+	   values of the splits that cannot raise the bound. */
+	if(tightBound_) {
+	  bound_ = adjustedDependency_;
+	  for(size_t m = 2; m < gains_.size(); ++m) {
+	    unsigned long dOfFreedom = std::max(dOfFreedom_, static_cast<unsigned long>(dOfFreedom_ * std::pow(m, growth_)));
+	    double gain = info + gains_[m] / n_;
+	    if(dOfFreedom != dOfFreedom_ && alpha_ <= .5 && (gain - (dOfFreedom - 2. / 3.) / (2. * n_)) / HY_ <= bound_)
+	      continue;
+	    bound_ = std::max(bound_, (gain - this->bias(dOfFreedom)) / HY_);
+	  }
+	} else
+	  bound_ = 1. - bias;	
 	// std::cerr << "info = " << info << std::endl;
 	// std::cerr << "DOF = " << dOfFreedom_ << std::endl;
 	// std::cerr << "bias = " << bias << std::endl;
       }
       
+      void extend(const Partition& partitionX) {
+	size_t NX = partitionX.size();
+	if(NX > 1) dOfFreedom_ *= (NX - 1);
+      }
+      
       AdjustedDependency operator()(const Partition& partitionX) const {
 	AdjustedDependency scorer = *this;
-	size_t NX = partitionX.size();
-	if(NX > 1) scorer.dOfFreedom_ *= (NX - 1);
+	scorer.extend(partitionX);
 	return partitionX.intersect(*partitionY_, scorer);	
       }
 
@@ -704,10 +882,16 @@ namespace gimlet {
     class SuzukiInfo : public PartitionScore<Partition, double> {
       using size_type = typename Partition::size_type;
 
-      double HX_, HY_, HXY_;
+      double HX_, HY_, HXY_, HYx_;
       unsigned long NX_, NY_, nx_, n_;
       double suzukiInfo_, bound_;
       const Partition *partitionY_;
+      bool tightBound_;
+      std::vector<double> gains_;
+
+      double bias(double NX) const {
+	return (NX - 1) * (NY_ - 1)/ (2. * n_) * std::log2(n_);
+      }
             
     public:
       using value_t = double;
@@ -716,7 +900,9 @@ namespace gimlet {
 	return v1 < v2;
       }
 
-      SuzukiInfo() = default;
+      SuzukiInfo(bool tightBound = true) :
+	HX_(0.), HY_(0.), HXY_(0.), HYx_(0.), NX_(0), NY_(0), nx_(0), n_(0),
+	suzukiInfo_(0.), bound_(0.), partitionY_(nullptr), tightBound_(tightBound), gains_() {}
       SuzukiInfo(const SuzukiInfo&) = default;
       
       void setTarget(const Partition& target) {
@@ -725,24 +911,35 @@ namespace gimlet {
 	HY_ = H;
 	n_ = H.count();
 	NY_ = target.nParts();
+	if(tightBound_) gains_.resize(NY_ + 1);
       }
 
       void begin(size_type NX, size_type NY) {
 	NX_ = NX;
 	HX_ = HXY_ = 0;
+	std::fill(gains_.begin(), gains_.end(), 0.);
       }
       
       void subbegin() {
 	nx_ = 0.;
+	HYx_ = 0.;
       }
       
       void update(double nxy) {
 	HXY_ += xlogx(nxy);
+	HYx_ += xlogx(nxy);
 	nx_ += nxy;
       }
 
+      /* gains_[m] accumulates nx * min(H(Y|x), log2 m): the largest information gain
+	 that splitting every part of X into m subparts can bring. */
       void subend() {
 	HX_ += xlogx(nx_);
+	if(tightBound_ && nx_ > 0) {
+	  double HYx = std::log2(nx_) - HYx_ / nx_;
+	  for(size_t m = 2; m < gains_.size(); ++m)
+	    gains_[m] += nx_ * std::min(HYx, std::log2(m));
+	}
       }
       
       void end() {
@@ -750,9 +947,15 @@ namespace gimlet {
 	HX_ = logn - HX_ / n_;
 	HXY_ = logn - HXY_ / n_;
 	double info = (HY_ + HX_ - HXY_);
-	double bias = (NX_ - 1) * (NY_ - 1)/ (2. * n_) * std::log2(n_);
-	suzukiInfo_ = (info - bias) / HY_;
-	bound_ = 1. - bias;	
+	suzukiInfo_ = (info - bias(NX_)) / HY_;
+	/* Any specialization multiplies NX by the number m of values of the added attributes.
+	   Beyond m = NY, the gain is maximal while the bias keeps growing. */
+	if(tightBound_) {
+	  bound_ = suzukiInfo_;
+	  for(size_t m = 2; m < gains_.size(); ++m)
+	    bound_ = std::max(bound_, (info + gains_[m] / n_ - bias(NX_ * m)) / HY_);
+	} else
+	  bound_ = 1. - bias(NX_);
 	// std::cerr << "info = " << info << std::endl;
 	// std::cerr << "bias = " << bias << " NX = " << NX_ << std::endl;
       }
@@ -766,6 +969,84 @@ namespace gimlet {
       	return { suzukiInfo_, bound_ };
       }      
     };    
+
+    /*
+     * Computes several scores with a single intersection: the contingency table
+     * is streamed once to every component scorer. Scores and bounds are returned
+     * as one lane per component, in the order of the template arguments.
+     * All components are assumed to be maximized.
+     */
+    template<typename Partition, typename... Scorers>
+    class CompositeScore : public PartitionScore<Partition, std::array<double, sizeof...(Scorers)>> {
+      using size_type = typename Partition::size_type;
+
+      std::tuple<Scorers...> scorers_;
+      const Partition *partitionY_;
+
+      template<typename Func> void forEach(Func func) {
+	std::apply([&func] (auto&... scorers) { (func(scorers), ...); }, scorers_);
+      }
+      
+    public:
+      using value_t = std::array<double, sizeof...(Scorers)>;
+
+      static bool comparator(double v1, double v2) {
+	return v1 < v2;
+      }
+
+      static constexpr size_t lanes() { return sizeof...(Scorers); }
+      
+      CompositeScore(const Scorers&... scorers) : scorers_(scorers...), partitionY_() {}
+      CompositeScore(const CompositeScore&) = default;
+
+      void setTarget(const Partition& target) {
+	partitionY_ = &target;
+	forEach([&target] (auto& scorer) { scorer.setTarget(target); });
+      }
+
+      void setMinValues(size_t m) {
+	forEach([m] (auto& scorer) { scorer.setMinValues(m); });
+      }
+
+      void extend(const Partition& partitionX) {
+	forEach([&partitionX] (auto& scorer) { scorer.extend(partitionX); });
+      }
+      
+      void begin(size_type NX, size_type NY) {
+	forEach([NX, NY] (auto& scorer) { scorer.begin(NX, NY); });
+      }
+      
+      void subbegin() {
+	forEach([] (auto& scorer) { scorer.subbegin(); });
+      }
+      
+      void update(double count) {
+	forEach([count] (auto& scorer) { scorer.update(count); });
+      }
+
+      void subend() {
+	forEach([] (auto& scorer) { scorer.subend(); });
+      }
+      
+      void end() {
+	forEach([] (auto& scorer) { scorer.end(); });
+      }
+      
+      CompositeScore operator()(const Partition& partitionX) const {
+	CompositeScore scorer = *this;
+	scorer.extend(partitionX);
+	return partitionX.intersect(*partitionY_, scorer);	
+      }
+
+      operator std::pair<value_t, value_t>() const {
+	std::pair<value_t, value_t> result;
+	size_t lane = 0;
+	std::apply([&result, &lane] (const auto&... scorers) {
+	    ((std::tie(result.first[lane], result.second[lane]) = static_cast<std::pair<double, double>>(scorers), ++lane), ...);
+	  }, scorers_);
+	return result;
+      }
+    };
         
   }
 }
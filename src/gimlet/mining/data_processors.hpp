@@ -1,14 +1,29 @@
 #pragma once
 
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <memory>
 #include <vector>
 #include <deque>
 #include <tuple>
+#include <optional>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+
+#include <boost/functional/hash.hpp>
 
 #include <gimlet/statistics.hpp>
+#include <gimlet/memory_budget.hpp>
 #include <gimlet/topk_queue.hpp>
-#include <gimlet/json_parser.hpp>
+#include <gimlet/concurrent_topk.hpp>
+#include <gimlet/small_vector.hpp>
+#include <gimlet/itemsets.hpp>
+#include <gimlet/encoded_parser.hpp>
+#include <gimlet/mining/pattern_text_writer.hpp>
+#include <gimlet/mining/topk_snapshots.hpp>
 #include <gimlet/data_iterator.hpp>
 
 #include "list.hpp"
@@ -20,60 +35,315 @@ namespace gimlet {
     template<typename OutputFormat>
     struct PatternWriter {
       using output_format = OutputFormat;
-      using parser_t = JSONParser<flow<output_format>>;
+      using parser_t = EncodedParser<flow<output_format>>;
       using stream_t = output_stream_t<parser_t>;
 
+      std::ostream* os_ = nullptr;
+      std::vector<std::string> names_;
+      // JSON text is formatted by hand, other encodings go through the stream
+      std::unique_ptr<PatternTextWriter> text_;
       stream_t outputDataStream_;
       output_stream_iterator_t<stream_t> outputIt_;
 
       template<typename Pattern, typename Score>
       void output_sorted(Pattern pattern, const Score& score) {
         std::sort(pattern.begin(), pattern.end());
-	*outputIt_++ = std::pair{pattern, score};
+	if constexpr(std::is_arithmetic_v<Score>) {
+	  if(text_) {
+	    text_->write(pattern, score);
+	    return;
+	  }
+	}
+	write(std::pair{pattern, score});
+      }
+
+      /* Writes an element of the output format */
+      template<typename Value>
+      void write(const Value& value) {
+	if(text_) {
+	  std::ostringstream element;
+	  if(! names_.empty()) set_names(element, &names_);
+	  JSONParser<output_format>().write(element, value);
+	  text_->write(element.str());
+	} else
+	  *outputIt_++ = value;
+      }
+
+      /* Writes the fields of the patterns output from now on by name (see set_names) */
+      void setNames(const std::vector<std::string>& names) {
+	names_ = names;
+	if(text_) text_->setNames(names_); else set_names(*os_, &names_);
       }
 
       PatternWriter() = default;
-      PatternWriter(std::ostream& os) : outputDataStream_(os, parser_t{}) {
-	outputIt_ = {outputDataStream_};
+      PatternWriter(std::ostream& os) : os_(&os), names_(), text_(), outputDataStream_(), outputIt_() {
+	if(output_encoding() == Encoding::json)
+	  text_ = std::make_unique<PatternTextWriter>(os);
+	else {
+	  outputDataStream_ = stream_t(os, parser_t{});
+	  outputIt_ = {outputDataStream_};
+	}
+      }
+      ~PatternWriter() {
+	if(os_ && ! names_.empty()) set_names(*os_, nullptr);
       }
     };
 
     struct Statistics : cool::Statistics {
       double totalTime_;
       unsigned int patternNumber_;
+      unsigned int recomputedColumns_;
+      unsigned int redundantColumns_;
       Statistics() : cool::Statistics() {
 	addDouble("total time", totalTime_, "s");
 	addInteger("pattern number", patternNumber_);
+	addInteger("recomputed columns", recomputedColumns_);
+	addInteger("redundant columns", redundantColumns_);
+	cool::MemoryBudget::instance().addStatistics(*this, cool::MemoryBudget::partitionCells);
+	cool::MemoryBudget::instance().addStatistics(*this, cool::MemoryBudget::partitionParts);
       }
     };   
     
+    template<typename Field>
+    struct RedundantColumns {
+      std::vector<Field> constants_;
+      // Classes of equivalent columns having more than one member, indexed by their kept column (first member)
+      std::map<Field, std::vector<Field>> classes_;
+      // Kept column of every column removed as equivalent to it
+      std::map<Field, Field> kept_;
+    };
+
+    /*
+     * Removes from columns the ones that cannot change a score only depending on
+     * the non-empty parts of the partitions (see PartitionScore::redundancy_invariant):
+     * constant columns and columns equal, up to a renaming of their values, to a
+     * previous column. Columns are compared through hashes of their value sequences,
+     * values being numbered by order of appearance.
+     */
+    template<typename Columns>
+    RedundantColumns<typename Columns::field_t> removeRedundantColumns(Columns& columns) {
+      using field_t = typename Columns::field_t;
+      using column_t = typename Columns::column_t;
+      using size_type = typename column_t::size_type;
+
+      auto canonicalLabels = [] (const column_t& column) {
+	std::vector<size_type> labels = column.labels();
+	std::vector<size_type> renaming(column.nParts(), static_cast<size_type>(-1));
+	size_type next = 0;
+	for(size_type& label : labels) {
+	  if(renaming[label] == static_cast<size_type>(-1)) renaming[label] = next++;
+	  label = renaming[label];
+	}
+	return labels;
+      };
+
+      RedundantColumns<field_t> redundant;
+      std::unordered_map<size_t, std::vector<field_t>> representatives;
+      std::vector<field_t> removed;
+      for(auto col = columns.begin(), end = columns.end(); col != end; ++col) {
+	field_t field = col.index();
+	if(col->nNonEmptyParts() <= 1) {
+	  redundant.constants_.push_back(field);
+	  removed.push_back(field);
+	  continue;
+	}
+	std::vector<size_type> labels = canonicalLabels(*col);
+	std::vector<field_t>& candidates = representatives[boost::hash_range(labels.begin(), labels.end())];
+	auto it = std::find_if(candidates.begin(), candidates.end(),
+			       [&] (field_t candidate) { return canonicalLabels(columns[candidate]) == labels; });
+	if(it == candidates.end())
+	  candidates.push_back(field);
+	else {
+	  std::vector<field_t>& equivalents = redundant.classes_[*it];
+	  if(equivalents.empty()) equivalents.push_back(*it);
+	  equivalents.push_back(field);
+	  redundant.kept_[field] = *it;
+	  removed.push_back(field);
+	}
+      }
+      for(field_t field : removed)
+	columns.remove(field);
+      return redundant;
+    }
+    
     template<typename Scorer, typename Columns>
+    using pattern_format_t = tuple<list<named<typename Columns::field_t>>, typename Scorer::value_t>;
+    
+    template<typename Scorer, typename Columns, typename OutputFormat = pattern_format_t<Scorer, Columns>>
     struct ProcessorWithScorer {
       using scorer_t = Scorer;
       using score_t = typename scorer_t::value_t;
       using columns_t = Columns;
       using column_t = typename columns_t::column_t;
       using field_t = typename columns_t::field_t;      
-      using varset_type = std::vector<field_t>;
+      using varset_type = cool::small_vector<field_t, inlinePatternSize>;
       
       scorer_t scorer_;
-      PatternWriter<tuple<list<field_t>, score_t>> writer_;      
+      PatternWriter<OutputFormat> writer_;      
       Statistics stats_;
+      bool removeRedundant_;
+      RedundantColumns<field_t> redundant_;
+      std::string columnStore_;
+      size_t nResidentColumns_;
+      size_t nLoadThreads_;
 
-      void preprocess(columns_t& columns) {}
+      void configure(columns_t& columns) {
+	if(! columnStore_.empty()) columns.setColumnStore(columnStore_, nResidentColumns_);
+      }
+      /* Patterns are output with the names of the columns when the data have some */
+      void nameFields(const columns_t& columns) {
+	if(! columns.dictionary().empty()) writer_.setNames(columns.dictionary().names_);
+      }
+
+      void preprocess(columns_t& columns) {
+	if(removeRedundant_) {
+	  if constexpr(! scorer_t::redundancy_invariant)
+	    throw std::invalid_argument("Redundant columns may change the scores of this scoring function"s);
+	  auto nColumns = [&columns] () {
+	    unsigned int n = 0;
+	    for(auto col = columns.begin(), end = columns.end(); col != end; ++col) ++n;
+	    return n;
+	  };
+	  const unsigned int n = nColumns();
+	  redundant_ = removeRedundantColumns(columns);
+	  stats_.redundantColumns_ = n - nColumns();
+	}
+      }
+      /* Loads the columns to mine from a file (standard input if empty) */
+      void load(columns_t& columns, const std::string& inputFileName) {
+	configure(columns);
+	columns.load(inputFileName, nLoadThreads_);
+	nameFields(columns);
+      }
+      void postprocess(columns_t& columns) {}
 
       Statistics& statistics() { return stats_; }
+
+      /* Excludes redundant columns from the search (see removeRedundantColumns()) */
+      void setRedundantColumnRemoval(bool enabled) { removeRedundant_ = enabled; }
+
+      /* Keeps columns out of core in directory (none if empty), at most nResident of them in memory */
+      void setColumnStore(const std::string& directory, size_t nResident) {
+	columnStore_ = directory;
+	nResidentColumns_ = nResident;
+      }
+
+      /* Number of threads parsing input files */
+      void setLoadThreads(size_t nThreads) { nLoadThreads_ = nThreads; }
+
+      /* Fields of the columns kept in place of the ones of pattern (see removeRedundantColumns()) */
+      template<typename Pattern>
+      Pattern keptFields(const Pattern& pattern) const {
+	Pattern kept;
+	for(field_t field : pattern) {
+	  if(std::binary_search(redundant_.constants_.begin(), redundant_.constants_.end(), field)) continue;
+	  auto it = redundant_.kept_.find(field);
+	  if(it != redundant_.kept_.end()) field = it->second;
+	  if(std::find(kept.begin(), kept.end(), field) == kept.end()) kept.push_back(field);
+	}
+	return kept;
+      }
+
+      /*
+       * Calls output(p) for the limit first patterns p having the partition of pattern,
+       * in lexicographic order of their sorted fields: every field of pattern is replaced
+       * with a non-empty subset of its class of equivalent columns and any subset of the
+       * constant columns is added
+       */
+      template<typename Pattern, typename Output>
+      void expand(const Pattern& pattern, const Output& output, size_t limit = std::numeric_limits<size_t>::max()) const {
+	if(limit == 0) return;
+	const Pattern base = keptFields(pattern);
+	const size_t n = base.size();
+	// Candidate fields in increasing order, with the index of the field of pattern they are equivalent to (n for constant columns)
+	std::vector<std::pair<field_t, size_t>> candidates;
+	for(size_t index = 0; index != n; ++index) {
+	  auto it = redundant_.classes_.find(base[index]);
+	  if(it == redundant_.classes_.end())
+	    candidates.emplace_back(base[index], index);
+	  else
+	    for(field_t field : it->second) candidates.emplace_back(field, index);
+	}
+	for(field_t field : redundant_.constants_) candidates.emplace_back(field, n);
+	std::sort(candidates.begin(), candidates.end());
+
+	std::vector<size_t> last(n), nChosen(n + 1, 0);
+	for(size_t position = 0; position != candidates.size(); ++position)
+	  if(candidates[position].second != n) last[candidates[position].second] = position;
+	size_t nMissing = n;
+	Pattern expanded;
+	// Depth-first visit of the sorted patterns, skipping the ones that cannot cover every field of pattern any more
+	auto visit = [&] (auto& visit, size_t from) -> bool {
+	  if(nMissing == 0) {
+	    output(static_cast<const Pattern&>(expanded));
+	    if(--limit == 0) return false;
+	  }
+	  for(size_t position = from; position != candidates.size(); ++position) {
+	    for(size_t index = 0; index != n; ++index)
+	      if(nChosen[index] == 0 && last[index] < position) return true;
+	    const auto [field, index] = candidates[position];
+	    expanded.push_back(field);
+	    if(nChosen[index]++ == 0 && index != n) --nMissing;
+	    bool more = visit(visit, position + 1);
+	    if(--nChosen[index] == 0 && index != n) ++nMissing;
+	    expanded.pop_back();
+	    if(! more) return false;
+	  }
+	  return true;
+	};
+	visit(visit, 0);
+      }
+
+      /*
+       * First pattern output by expand(), that ranks pattern among patterns of equal scores:
+       * the expansions of a top-k then contain the top-k of the search without redundant
+       * columns removed (see expandTopK())
+       */
+      template<typename Pattern>
+      Pattern representative(const Pattern& pattern) const {
+	Pattern first = pattern;
+	if(removeRedundant_)
+	  expand(pattern, [&] (const Pattern& p) { first = p; }, 1);
+	else
+	  std::sort(first.begin(), first.end());
+	return first;
+      }
+
+      /*
+       * Expands the entries of a top-k of size K, given best first, and returns the K best
+       * of their expansions, best first, with the indices of their entries. Expansions have
+       * the score of their entry and ties are broken by their sorted fields.
+       */
+      template<typename Entry>
+      std::vector<std::pair<size_t, varset_type>> expandTopK(const std::vector<Entry>& entries, size_t K) const {
+	std::vector<std::pair<size_t, varset_type>> patterns;
+	for(size_t index = 0; index != entries.size(); ++index) {
+	  if(patterns.size() >= K && scorer_t::comparator(entries[index].score(), entries[patterns.back().first].score())) break;
+	  expand(entries[index].fields(), [&] (const varset_type& pattern) { patterns.emplace_back(index, pattern); }, K);
+	}
+	if(removeRedundant_) {
+	  std::stable_sort(patterns.begin(), patterns.end(), [&] (const auto& p1, const auto& p2) {
+	      const score_t& s1 = entries[p1.first].score();
+	      const score_t& s2 = entries[p2.first].score();
+	      if(scorer_t::comparator(s2, s1)) return true;
+	      if(scorer_t::comparator(s1, s2)) return false;
+	      return p1.second < p2.second;
+	    });
+	  if(patterns.size() > K) patterns.erase(patterns.begin() + K, patterns.end());
+	}
+	return patterns;
+      }
       
       ProcessorWithScorer(const scorer_t& scorer, std::ostream& output) :
-	scorer_(scorer), writer_(output), stats_{} {}
+	scorer_(scorer), writer_(output), stats_{}, removeRedundant_(false), redundant_(), columnStore_(), nResidentColumns_(0), nLoadThreads_(1) {}
     };
 
-    template<typename Scorer, typename Columns>
-    struct ProcessorWithTarget : ProcessorWithScorer<Scorer, Columns> {
-      using columns_t = ProcessorWithScorer<Scorer, Columns>::columns_t;
-      using column_t  = ProcessorWithScorer<Scorer, Columns>::column_t;
-      using scorer_t  = ProcessorWithScorer<Scorer, Columns>::scorer_t;
-      using ProcessorWithScorer<Scorer, Columns>::scorer_;
+    template<typename Scorer, typename Columns, typename OutputFormat = pattern_format_t<Scorer, Columns>>
+    struct ProcessorWithTarget : ProcessorWithScorer<Scorer, Columns, OutputFormat> {
+      using columns_t = ProcessorWithScorer<Scorer, Columns, OutputFormat>::columns_t;
+      using column_t  = ProcessorWithScorer<Scorer, Columns, OutputFormat>::column_t;
+      using scorer_t  = ProcessorWithScorer<Scorer, Columns, OutputFormat>::scorer_t;
+      using ProcessorWithScorer<Scorer, Columns, OutputFormat>::scorer_;
       
       int target_;
       column_t target_column_;
@@ -84,13 +354,14 @@ namespace gimlet {
 	    if(target_ < 0 || target_ >= static_cast<int>(columns.size()))
 	      throw std::invalid_argument("Target index out of bounds");
 	    
-	    target_column_ = {std::move(columns[target_])};
+	    target_column_ = columns.remove(target_);
 	    scorer_.setTarget(target_column_);
 	  }
+	ProcessorWithScorer<Scorer, Columns, OutputFormat>::preprocess(columns);
       }
       
       ProcessorWithTarget(int target, const scorer_t& scorer, std::ostream& output) :
-	ProcessorWithScorer<Scorer, Columns>(scorer, output), target_(target), target_column_() {}
+	ProcessorWithScorer<Scorer, Columns, OutputFormat>(scorer, output), target_(target), target_column_() {}
     };
     
     template<typename Scorer, typename Columns>
@@ -168,12 +439,13 @@ namespace gimlet {
       }
 
       void push(const varset_type& pattern, const state_t& state) {
-	writer_.output_sorted(pattern, state.score_);
+	this->expand(pattern, [&] (const varset_type& p) { writer_.output_sorted(p, state.score_); });
       }
       void pop(const state_t&) {}
     };
     
-    template<typename Scorer, typename Columns>
+    /* Snapshots: the top-k is locked for the snapshots taken while the columns are searched (see TopKSnapshots) */
+    template<typename Scorer, typename Columns, bool Snapshots = false>
     struct TopKProcessor : ProcessorWithTarget<Scorer, Columns> {
       using columns_t = ProcessorWithScorer<Scorer, Columns>::columns_t;
       using column_t  = ProcessorWithScorer<Scorer, Columns>::column_t;
@@ -189,15 +461,25 @@ namespace gimlet {
       };
       using state_t = State;
 
+      struct ScoreComparator {
+	bool operator()(const score_t& s1, const score_t& s2) const { return scorer_t::comparator(s1, s2); }
+      };
+
       struct Entry : std::pair<varset_type, score_t> {
 	varset_type& fields() { return this->first; }
+	const varset_type& fields() const { return this->first; }
 	const score_t& score() const { return this->second; }
-	bool operator<(const Entry& other) const { return scorer_t::comparator(this->score(), other.score()); }
+	/* Ties are broken by patterns so that the top-k does not depend on the search order */
+	bool operator<(const Entry& other) const {
+	  if(scorer_t::comparator(this->score(), other.score())) return true;
+	  if(scorer_t::comparator(other.score(), this->score())) return false;
+	  return other.fields() < this->fields();
+	}
 
 	Entry(const varset_type& varset, const score_t& score) : std::pair<varset_type, score_t>(varset, score) {}
       };
             
-      cool::topk_queue<Entry> queue_;
+      cool::concurrent_topk<Entry, ScoreComparator, Snapshots> queue_;
             
       bool worse(const state_t& s1, const state_t& s2) const {
 	return scorer_t::comparator(s1.score_, s2.score_);
@@ -207,17 +489,38 @@ namespace gimlet {
 	ProcessorWithTarget<Scorer, Columns>(target, scorer, output), queue_{K} {}
       
       ~TopKProcessor() {
-	auto sort_variables = [] (Entry entry) -> Entry {
-				varset_type& pattern = entry.first;
-				std::sort(pattern.begin(), pattern.end());
-				return entry;
-			      };
-	queue_.purge(writer_.outputIt_, sort_variables);
+	if constexpr(Snapshots) TopKSnapshots::instance().stop();
+	std::vector<Entry> entries;
+	queue_.purge(std::back_inserter(entries));
+	for(const auto& [index, pattern] : this->expandTopK(entries, queue_.maxsize()))
+	  writer_.output_sorted(pattern, entries[index].score());
+      }
+
+      /* Snapshots of the top-k (see TopKSnapshots) are taken while the columns are searched */
+      void preprocess(columns_t& columns) {
+	ProcessorWithTarget<Scorer, Columns>::preprocess(columns);
+	if constexpr(Snapshots)
+	  TopKSnapshots::instance().start([this] () {
+	      std::vector<Entry> entries = snapshot();
+	      std::vector<std::pair<varset_type, score_t>> patterns;
+	      for(const auto& [index, pattern] : this->expandTopK(entries, queue_.maxsize()))
+		patterns.emplace_back(pattern, entries[index].score());
+	      return TopKSnapshots::format<list<pattern_format_t<Scorer, Columns>>>(patterns, writer_.names_);
+	    });
+      }
+      void postprocess(columns_t&) {
+	if constexpr(Snapshots) TopKSnapshots::instance().stop();
+      }
+
+      /* Current top-k, best first */
+      std::vector<Entry> snapshot() {
+	std::vector<Entry> entries;
+	queue_.snapshot(std::back_inserter(entries));
+	return entries;
       }
 
       bool accept(const state_t& state) const {
-	score_t worst_score =	queue_.last().score();
-	return (! queue_.full()) || scorer_t::comparator(worst_score, state.bound_);
+	return queue_.accepts(state.bound_);
       }
       
       std::pair<state_t, bool> compute_state(column_t& column) const {
@@ -236,7 +539,7 @@ namespace gimlet {
       }
 
       void push(const varset_type& pattern, const state_t& state) {
-	queue_.push(Entry{pattern, state.score_});
+	queue_.push(Entry{this->representative(pattern), state.score_});
       }
       void pop(const state_t&) {}
     };
@@ -300,7 +603,7 @@ namespace gimlet {
 
       void push(const varset_type& pattern, const state_t& state) {
 	if(scorer_t::comparator(*score_lower_bound_, state.score_))
-	  writer_.output_sorted(pattern, state.score_);
+	  this->expand(pattern, [&] (const varset_type& p) { writer_.output_sorted(p, state.score_); });
       }
       void pop(const state_t&) {}
     };
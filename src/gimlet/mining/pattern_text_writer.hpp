@@ -0,0 +1,89 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <future>
+#include <charconv>
+#include <type_traits>
+
+namespace gimlet {
+  namespace itemsets {
+
+    /*
+     * Writer of a JSON flow of (pattern, score) pairs producing the same text as
+     * JSONParser, but formatted by hand with std::to_chars into a large buffer
+     * rather than through the locale-aware operators of the stream. Full buffers
+     * are handed to a background thread writing them out in one block while the
+     * search fills the other one, so that searches outputting millions of
+     * patterns do not wait on the formatting nor on the I/O.
+     */
+    class PatternTextWriter {
+      static constexpr size_t blockSize = size_t(1) << 20;
+
+      std::ostream& os_;
+      std::string buffer_;
+      std::string writing_;
+      std::future<void> written_;
+      // Fields already written as JSON strings when the data have names
+      std::vector<std::string> names_;
+      bool first_;
+
+      void flush();
+
+      template<typename Integer>
+      void append(Integer value) {
+	char digits[24];
+	buffer_.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+      }
+
+      void appendScore(double score) {
+	// Same digits as operator<< with the default precision
+	char digits[32];
+	buffer_.append(digits, std::to_chars(digits, digits + sizeof(digits), score, std::chars_format::general, 6).ptr);
+      }
+
+      void beginElement() {
+	buffer_.append(first_ ? "  " : ",\n  ");
+	first_ = false;
+      }
+
+      void endElement() {
+	if(buffer_.size() >= blockSize) flush();
+      }
+
+    public:
+      /* Writes the start of the flow */
+      PatternTextWriter(std::ostream& os);
+      PatternTextWriter(const PatternTextWriter&) = delete;
+      PatternTextWriter& operator=(const PatternTextWriter&) = delete;
+      /* Writes the end of the flow and waits for all the text to be written */
+      ~PatternTextWriter();
+
+      /* Writes the fields of the patterns by name from now on */
+      void setNames(const std::vector<std::string>& names);
+
+      template<typename Pattern, typename Score>
+      void write(const Pattern& pattern, Score score) {
+	static_assert(std::is_arithmetic_v<Score>, "scores are numbers");
+	beginElement();
+	buffer_.append("[[");
+	bool first = true;
+	for(auto field : pattern) {
+	  if(! first) buffer_.append(", ");
+	  first = false;
+	  if(static_cast<size_t>(field) < names_.size()) buffer_.append(names_[field]);
+	  else append(field);
+	}
+	buffer_.append("], ");
+	if constexpr(std::is_floating_point_v<Score>) appendScore(score); else append(score);
+	buffer_.push_back(']');
+	endElement();
+      }
+
+      /* Writes an element of the flow already formatted */
+      void write(std::string_view element);
+    };
+  }
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <vector>
+#include <tuple>
+#include <random>
+#include <algorithm>
+#include <iterator>
+
+#include <gimlet/timer.hpp>
+#include <gimlet/thread_pool.hpp>
+#include <gimlet/mining/data_partition.hpp>
+#include <gimlet/mining/data_processors.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    /*
+     * Model of the partition concept that only stores the part label of every row.
+     * Scorers instantiated on this type rescore a fixed partition against a
+     * resampled target without copying any data partition.
+     * Optional row weights (e.g. bootstrap multiplicities) apply to part sizes and,
+     * when the partition is the second operand of intersect(), to the contingency table.
+     */
+    class LabelPartition {
+    public:
+      using size_type = Partition::size_type;
+
+    private:
+      std::vector<size_type> labels_, rows_, offsets_;
+      size_type nParts_;
+      const std::vector<size_type>* weights_ = nullptr;
+
+      void group();
+      size_type weight(size_type row) const { return weights_ ? (*weights_)[row] : 1; }
+
+    public:
+      LabelPartition() = default;
+      LabelPartition(const Partition& partition);
+      /* Labels must number the nNonEmptyParts non empty parts from 0 */
+      LabelPartition(std::vector<size_type> labels, size_type nParts, size_type nNonEmptyParts);
+      LabelPartition(const LabelPartition&) = default;
+      LabelPartition& operator=(const LabelPartition&) = default;
+
+      size_t size() const { return labels_.size(); }
+      size_t nParts() const { return nParts_; }
+      size_t nNonEmptyParts() const { return offsets_.size() - 1; }
+
+      void setWeights(const std::vector<size_type>* weights) { weights_ = weights; }
+
+      template<typename URNG>
+      void shuffle(URNG& rng) {
+	std::shuffle(labels_.begin(), labels_.end(), rng);
+	group();
+      }
+
+      template<typename Score>
+      Score score(Score score) const;
+
+      template<typename Score>
+      Score intersect(const LabelPartition& other, Score score) const;
+    };
+
+    template<typename Score>
+    Score LabelPartition::score(Score score) const {
+      score.begin(nParts());
+      for(size_type part = 0; part != nNonEmptyParts(); ++part) {
+	size_type n = 0;
+	if(weights_) {
+	  for(size_type index = offsets_[part]; index != offsets_[part + 1]; ++index)
+	    n += weight(rows_[index]);
+	} else
+	  n = offsets_[part + 1] - offsets_[part];
+	if(n != 0) score.update(n);
+      }
+      score.end();
+      return score;
+    }
+
+    template<typename Score>
+    Score LabelPartition::intersect(const LabelPartition& other, Score score) const {
+      assert(size() == other.size());
+
+      std::vector<size_type> counts(other.nNonEmptyParts(), 0), touched;
+      touched.reserve(counts.size());
+
+      score.begin(nParts(), other.nParts());
+      for(size_type part = 0; part != nNonEmptyParts(); ++part) {
+	for(size_type index = offsets_[part]; index != offsets_[part + 1]; ++index) {
+	  size_type row = rows_[index];
+	  size_type weight = other.weight(row);
+	  if(weight == 0) continue;
+	  size_type otherPart = other.labels_[row];
+	  if(counts[otherPart] == 0) touched.push_back(otherPart);
+	  counts[otherPart] += weight;
+	}
+	if(touched.empty()) continue;
+	
+	score.subbegin();
+	for(size_type otherPart : touched) {
+	  score.update(counts[otherPart]);
+	  counts[otherPart] = 0;
+	}
+	touched.clear();
+	score.subend();
+      }
+      score.end();
+      return score;
+    }
+
+    /*
+     * Top-k processor that assesses every top-k pattern once the search is over:
+     * - its p-value is estimated with a permutation test, comparing its score
+     *   to its scores against randomly permuted targets;
+     * - a percentile confidence interval of its score is estimated by bootstrap,
+     *   rows being resampled as multinomial weights.
+     * Replicates are spread over a thread pool and seeded by their index, so that
+     * results do not depend on the number of threads.
+     * Every output is [pattern, score, p-value, [lower bound, upper bound]].
+     * ReplicateScorer must be the scorer type instantiated on LabelPartition.
+     */
+    template<typename Scorer, typename Columns, typename ReplicateScorer>
+    struct ResamplingTopKProcessor : ProcessorWithTarget<Scorer, Columns, tuple<list<named<typename Columns::field_t>>, typename Scorer::value_t, double, tuple<double, double>>> {
+      using parent_t = ProcessorWithTarget<Scorer, Columns, tuple<list<named<typename Columns::field_t>>, typename Scorer::value_t, double, tuple<double, double>>>;
+      using columns_t = typename parent_t::columns_t;
+      using column_t  = typename parent_t::column_t;
+      using scorer_t  = typename parent_t::scorer_t;
+      using score_t   = typename parent_t::score_t;
+      using field_t   = typename parent_t::field_t;
+      using varset_type  = typename parent_t::varset_type;
+      using size_type = LabelPartition::size_type;
+      using parent_t::scorer_;
+      using parent_t::writer_;
+      using parent_t::stats_;
+      using parent_t::target_column_;
+
+      struct State {
+	score_t score_;
+	score_t bound_;
+      };
+      using state_t = State;
+
+      struct Entry : std::pair<varset_type, score_t> {
+	varset_type& fields() { return this->first; }
+	const varset_type& fields() const { return this->first; }
+	const score_t& score() const { return this->second; }
+	bool operator<(const Entry& other) const {
+	  if(scorer_t::comparator(this->score(), other.score())) return true;
+	  if(scorer_t::comparator(other.score(), this->score())) return false;
+	  return other.fields() < this->fields();
+	}
+
+	Entry(const varset_type& varset, const score_t& score) : std::pair<varset_type, score_t>(varset, score) {}
+      };
+
+      cool::topk_queue<Entry> queue_;
+      ReplicateScorer replicateScorer_;
+      size_t nPermutations_, nBootstraps_, nThreads_;
+      bool pinned_;
+      double confidence_;
+      unsigned long seed_;
+      double resamplingTime_;
+
+      double quantile(const std::vector<double>& sorted, double q) const {
+	double position = q * (sorted.size() - 1);
+	size_t index = static_cast<size_t>(position);
+	if(index + 1 >= sorted.size()) return sorted.back();
+	return sorted[index] + (position - index) * (sorted[index + 1] - sorted[index]);
+      }
+
+      bool worse(const state_t& s1, const state_t& s2) const {
+	return scorer_t::comparator(s1.score_, s2.score_);
+      }
+
+      ResamplingTopKProcessor(size_t K, int target, size_t nPermutations, size_t nBootstraps, double confidence, unsigned long seed, size_t nThreads, bool pinned,
+			      std::ostream& output, const scorer_t& scorer, const ReplicateScorer& replicateScorer) :
+	parent_t(target, scorer, output), queue_{K}, replicateScorer_(replicateScorer),
+	nPermutations_(nPermutations), nBootstraps_(nBootstraps), nThreads_(std::max<size_t>(nThreads, 1)), pinned_(pinned),
+	confidence_(confidence), seed_(seed), resamplingTime_(0.) {
+	if(confidence <= 0. || confidence >= 1.) throw std::invalid_argument("Confidence level must be in ]0;1["s);
+	stats_.addDouble("resampling time", resamplingTime_, "s");
+      }
+
+      bool accept(const state_t& state) const {
+	return (! queue_.full()) || scorer_t::comparator(queue_.last().score(), state.bound_);
+      }
+
+      std::pair<state_t, bool> compute_state(column_t& column) const {
+	std::pair<state_t, bool> result;
+	state_t& state = result.first;
+	bool& accept = result.second;
+
+      	std::tie(state.score_, state.bound_) = scorer_(column);
+	accept = this->accept(state);
+	return result;
+      }
+
+      void push(const varset_type& pattern, const state_t& state) {
+	queue_.push(Entry{this->representative(pattern), state.score_});
+      }
+      void pop(const state_t&) {}
+
+      void postprocess(columns_t& columns);
+    };
+
+    template<typename Scorer, typename Columns, typename ReplicateScorer>
+    void ResamplingTopKProcessor<Scorer, Columns, ReplicateScorer>::postprocess(columns_t& columns) {
+      cool::Timer timer;
+      timer.start();
+
+      std::vector<Entry> entries;
+      queue_.purge(std::back_inserter(entries));
+      const size_t nEntries = entries.size();
+
+      LabelPartition target{target_column_};
+      std::vector<LabelPartition> patterns;
+      std::vector<score_t> observed;
+      {
+	ReplicateScorer scorer = replicateScorer_;
+	scorer.setTarget(target);
+	for(const Entry& entry : entries) {
+	  column_t col = columns.top();
+	  for(field_t field : this->keptFields(entry.fields()))
+	    col.intersect(columns[field]);
+	  patterns.emplace_back(col);
+	  observed.push_back(scorer(patterns.back()).first);
+	}
+      }
+
+      using counts_t = std::vector<unsigned long>;
+      const size_t nReplicates = nPermutations_ + nBootstraps_;
+      std::vector<std::vector<double>> bootstraps(nEntries, std::vector<double>(nBootstraps_));
+      counts_t exceeds(nEntries, 0);
+      if(nReplicates > 0) { // No thread pool to start without replicates
+	cool::ThreadPool threads{nThreads_ - 1, pinned_};
+	exceeds =
+	  cool::parallel_reduce(threads, size_t(0), nReplicates, counts_t(nEntries, 0),
+				[&] (size_t first, size_t last, counts_t exceed) {
+				  LabelPartition resampled;
+				  std::vector<size_type> weights;
+				  ReplicateScorer scorer = replicateScorer_;
+				
+				  for(size_t replicate = first; replicate != last; ++replicate) {
+				    resampled = target;
+				    if(replicate < nPermutations_) {
+				      std::seed_seq seq{seed_, static_cast<unsigned long>(replicate)};
+				      std::mt19937_64 rng{seq};
+				      resampled.shuffle(rng);
+				      scorer.setTarget(resampled);
+				      for(size_t index = 0; index != nEntries; ++index)
+					if(! scorer_t::comparator(scorer(patterns[index]).first, observed[index]))
+					  ++exceed[index];
+				    } else {
+				      size_t bootstrap = replicate - nPermutations_;
+				      std::seed_seq seq{seed_, static_cast<unsigned long>(bootstrap), 1ul};
+				      std::mt19937_64 rng{seq};
+				      std::uniform_int_distribution<size_type> draw(0, target.size() - 1);
+				      weights.assign(target.size(), 0);
+				      for(size_t n = target.size(); n != 0; --n)
+					++weights[draw(rng)];
+				      resampled.setWeights(&weights);
+				      scorer.setTarget(resampled);
+				      for(size_t index = 0; index != nEntries; ++index)
+					bootstraps[index][bootstrap] = scorer(patterns[index]).first;
+				    }
+				  }
+				  return exceed;
+				},
+				[] (counts_t total, const counts_t& exceed) {
+				  for(size_t index = 0; index != total.size(); ++index) total[index] += exceed[index];
+				  return total;
+				});
+      }
+
+      const double tail = (1. - confidence_) / 2.;
+      std::vector<double> pValues(nEntries);
+      std::vector<std::tuple<double, double>> intervals(nEntries);
+      for(size_t index = 0; index != nEntries; ++index) {
+	pValues[index] = (1. + exceeds[index]) / (1. + nPermutations_);
+	
+	intervals[index] = {observed[index], observed[index]};
+	std::vector<double>& replicates = bootstraps[index];
+	if(! replicates.empty()) {
+	  std::sort(replicates.begin(), replicates.end());
+	  intervals[index] = { quantile(replicates, tail), quantile(replicates, 1. - tail) };
+	}
+      }
+      // Patterns equivalent to an entry share its assessment
+      for(const auto& [index, pattern] : this->expandTopK(entries, queue_.maxsize()))
+	writer_.write(std::tuple{pattern, entries[index].score(), pValues[index], intervals[index]});
+      resamplingTime_ = timer.stop();
+    }
+  }
+}
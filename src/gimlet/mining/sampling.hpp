@@ -0,0 +1,394 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+#include <boost/functional/hash.hpp>
+
+#include <gimlet/timer.hpp>
+#include <gimlet/itemsets.hpp>
+#include <gimlet/csv_reader.hpp>
+#include <gimlet/compressed_input.hpp>
+#include <gimlet/mining/data_partition.hpp>
+#include <gimlet/mining/data_processors.hpp>
+#include <gimlet/mining/resampling.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    /*
+     * Selects the rows of a sampled search while they are read. Every row is kept
+     * with probability rate, either independently of the others (uniform sampling)
+     * or, when the sample is stratified on a field, by systematic sampling within
+     * every value of this field with a random start, so that the proportions of its
+     * values are preserved up to one row.
+     * The stratum field is given like the target of processors (negative values
+     * count from the last field).
+     */
+    class RowSampler {
+      using row_type = valued_row_type<wide_attribute_value_type>;
+
+      struct Stratum {
+	double start_;
+	unsigned long n_;
+      };
+
+      double rate_;
+      std::optional<int> stratum_;
+      std::mt19937_64 rng_;
+      std::uniform_real_distribution<double> uniform_;
+      std::unordered_map<wide_attribute_value_type, Stratum> strata_;
+
+    public:
+      RowSampler(double rate, unsigned long seed, std::optional<int> stratum = {});
+
+      bool operator()(const row_type& row);
+      double rate() const { return rate_; }
+    };
+
+    /*
+     * Base of the processors of two-phase sampled searches:
+     * - the search runs on a sample of the rows (see RowSampler), keeping an enlarged
+     *   set of candidates whose bounds are loosened by a margin accounting for the
+     *   sampling error;
+     * - once it is over, candidates are rescored exactly in a single streaming pass
+     *   over the whole input, which only keeps the contingency table of every
+     *   candidate against the target.
+     * The margin is the deviation of plug-in entropy estimates on the sample that
+     * McDiarmid's inequality bounds with the given confidence.
+     * ReplicateScorer must be the scorer type instantiated on LabelPartition.
+     */
+    template<typename Scorer, typename Columns, typename ReplicateScorer>
+    struct SampledProcessor : ProcessorWithTarget<Scorer, Columns> {
+      using parent_t = ProcessorWithTarget<Scorer, Columns>;
+      using columns_t = typename parent_t::columns_t;
+      using column_t  = typename parent_t::column_t;
+      using scorer_t  = typename parent_t::scorer_t;
+      using score_t   = typename parent_t::score_t;
+      using field_t   = typename parent_t::field_t;
+      using varset_type  = typename parent_t::varset_type;
+      using size_type = LabelPartition::size_type;
+      using parent_t::stats_;
+      using parent_t::target_;
+
+      struct State {
+	score_t score_;
+	score_t bound_;
+      };
+      using state_t = State;
+
+      struct Entry : std::pair<varset_type, score_t> {
+	varset_type& fields() { return this->first; }
+	const varset_type& fields() const { return this->first; }
+	const score_t& score() const { return this->second; }
+	/* Ties are broken by patterns so that rankings do not depend on the search order */
+	bool operator<(const Entry& other) const {
+	  if(scorer_t::comparator(this->score(), other.score())) return true;
+	  if(scorer_t::comparator(other.score(), this->score())) return false;
+	  return other.fields() < this->fields();
+	}
+
+	Entry(const varset_type& varset, const score_t& score) : std::pair<varset_type, score_t>(varset, score) {}
+      };
+
+      RowSampler sampler_;
+      std::string inputFileName_;
+      ReplicateScorer replicateScorer_;
+      double confidence_;
+      score_t margin_;
+      unsigned int sampledRows_, nCandidates_, rankingChanges_;
+      double verificationTime_;
+
+      SampledProcessor(int target, double rate, bool stratified, double confidence, unsigned long seed, const std::string& inputFileName,
+		       std::ostream& output, const scorer_t& scorer, const ReplicateScorer& replicateScorer) :
+	parent_t(target, scorer, output), sampler_(rate, seed, stratified ? std::optional<int>{target} : std::nullopt),
+	inputFileName_(inputFileName), replicateScorer_(replicateScorer), confidence_(confidence), margin_(0),
+	sampledRows_(0), nCandidates_(0), rankingChanges_(0), verificationTime_(0.) {
+	if(rate <= 0. || rate > 1.) throw std::invalid_argument("Sampling rate must be in ]0;1]"s);
+	if(confidence <= 0. || confidence >= 1.) throw std::invalid_argument("Confidence level must be in ]0;1["s);
+	if(inputFileName.empty()) throw std::invalid_argument("Sampled searches read their input twice and need an input file"s);
+	stats_.addInteger("sampled rows", sampledRows_);
+	stats_.addInteger("candidates", nCandidates_);
+	stats_.addInteger("ranking changes", rankingChanges_);
+	stats_.addDouble("verification time", verificationTime_, "s");
+      }
+
+      void load(columns_t& columns, const std::string& inputFileName) {
+	this->configure(columns);
+	cool::InputFile inputFile(inputFileName);
+	columns.load(inputFile, std::ref(sampler_));
+	this->nameFields(columns);
+	const double n = static_cast<double>(columns.top().nRows());
+	sampledRows_ = static_cast<unsigned int>(n);
+	if(n > 1.) margin_ = std::log2(n) * std::sqrt(2. * std::log(2. / (1. - confidence_)) / n);
+      }
+
+      void preprocess(columns_t& columns) {
+	if(this->removeRedundant_)
+	  throw std::invalid_argument("Columns redundant in a sample may not be redundant in the whole data"s);
+	parent_t::preprocess(columns);
+      }
+
+      bool worse(const state_t& s1, const state_t& s2) const {
+	return scorer_t::comparator(s1.score_, s2.score_);
+      }
+
+      std::pair<state_t, bool> compute_state(column_t& column) const;
+
+      std::vector<score_t> rescore(const std::vector<Entry>& candidates) const;
+    };
+
+    template<typename Scorer, typename Columns, typename ReplicateScorer>
+    std::vector<typename SampledProcessor<Scorer, Columns, ReplicateScorer>::score_t>
+    SampledProcessor<Scorer, Columns, ReplicateScorer>::rescore(const std::vector<Entry>& candidates) const {
+      using value_type = wide_attribute_value_type;
+      using key_type = std::vector<value_type>;
+      using cell_type = std::pair<size_type, size_type>;
+
+      // Contingency table of a candidate, its values and the target ones being numbered by order of appearance
+      struct Table {
+	std::unordered_map<key_type, size_type, boost::hash<key_type>> xs_;
+	std::unordered_map<cell_type, size_type, boost::hash<cell_type>> cells_;
+      };
+
+      cool::InputFile inputFile(inputFileName_);
+      std::vector<Table> tables(candidates.size());
+      std::map<field_t, std::unordered_set<value_type>> domains;
+      for(const Entry& candidate : candidates)
+	for(field_t field : candidate.fields()) domains[field];
+      std::unordered_map<value_type, size_type> ys;
+
+      std::vector<value_type> values;
+      key_type key;
+      Dictionary dictionary;
+      read_rows(inputFile, [&] (auto data, auto end) {
+	for(; data != end; ++data) {
+	  values.clear();
+	  for(const auto& [field, value] : *data) {
+	    if(field >= values.size()) values.resize(field + 1);
+	    values[field] = value;
+	  }
+	  if(static_cast<size_t>(target_) >= values.size()) throw std::runtime_error("Row without target");
+	  const size_type y = ys.try_emplace(values[target_], static_cast<size_type>(ys.size())).first->second;
+	  for(auto& [field, domain] : domains) domain.insert(values[field]);
+
+	  for(size_t index = 0; index != candidates.size(); ++index) {
+	    key.clear();
+	    for(field_t field : candidates[index].fields()) key.push_back(values[field]);
+	    Table& table = tables[index];
+	    const size_type x = table.xs_.try_emplace(key, static_cast<size_type>(table.xs_.size())).first->second;
+	    ++table.cells_[{x, y}];
+	  }
+	}
+      }, dictionary);
+
+      // Tables are scored as label partitions of their cells, the target being weighted by cell counts
+      std::vector<score_t> scores;
+      ReplicateScorer scorer = replicateScorer_;
+      std::vector<size_type> xLabels, yLabels, weights;
+      for(size_t index = 0; index != candidates.size(); ++index) {
+	const Table& table = tables[index];
+	size_type nParts = 1;
+	for(field_t field : candidates[index].fields()) nParts *= static_cast<size_type>(domains[field].size());
+
+	xLabels.clear(); yLabels.clear(); weights.clear();
+	for(const auto& [cell, n] : table.cells_) {
+	  xLabels.push_back(cell.first);
+	  yLabels.push_back(cell.second);
+	  weights.push_back(n);
+	}
+	const size_type nX = static_cast<size_type>(table.xs_.size()), nY = static_cast<size_type>(ys.size());
+	LabelPartition x{xLabels, nParts, nX}, y{yLabels, nY, nY};
+	y.setWeights(&weights);
+	scorer.setTarget(y);
+	scores.push_back(scorer(x).first);
+      }
+      return scores;
+    }
+
+    template<typename Scorer, typename Columns, typename ReplicateScorer>
+    std::pair<typename SampledProcessor<Scorer, Columns, ReplicateScorer>::state_t, bool>
+    SampledProcessor<Scorer, Columns, ReplicateScorer>::compute_state(column_t& column) const {
+      std::pair<state_t, bool> result;
+      std::tie(result.first.score_, result.first.bound_) = this->scorer_(column);
+      return result;
+    }
+
+    /*
+     * Sampled top-k search: the candidates are the top-k' patterns of the sample
+     * (k' >= k) and the patterns whose sampled scores are within twice the margin
+     * of the k-th best one. They are rescored exactly and the k best ones are output
+     * with their exact scores.
+     * The number of ranks of the top-k whose pattern changed once rescored is
+     * reported as ranking changes.
+     */
+    template<typename Scorer, typename Columns, typename ReplicateScorer>
+    struct SampledTopKProcessor : SampledProcessor<Scorer, Columns, ReplicateScorer> {
+      using parent_t = SampledProcessor<Scorer, Columns, ReplicateScorer>;
+      using columns_t = typename parent_t::columns_t;
+      using column_t  = typename parent_t::column_t;
+      using scorer_t  = typename parent_t::scorer_t;
+      using score_t   = typename parent_t::score_t;
+      using varset_type  = typename parent_t::varset_type;
+      using state_t = typename parent_t::state_t;
+      using Entry = typename parent_t::Entry;
+      using parent_t::writer_;
+      using parent_t::margin_;
+
+      size_t K_;
+      cool::topk_queue<Entry> top_, queue_;
+      std::vector<Entry> close_;
+      size_t compacted_;
+
+      bool close(const score_t& score) const {
+	return (! top_.full()) || ! scorer_t::comparator(score + 2 * margin_, top_.last().score());
+      }
+
+      SampledTopKProcessor(size_t K, size_t nCandidates, int target, double rate, bool stratified, double confidence, unsigned long seed,
+			   const std::string& inputFileName, std::ostream& output, const scorer_t& scorer, const ReplicateScorer& replicateScorer) :
+	parent_t(target, rate, stratified, confidence, seed, inputFileName, output, scorer, replicateScorer),
+	K_(K), top_{K}, queue_{std::max(K, nCandidates)}, close_(), compacted_(K) {}
+
+      bool accept(const state_t& state) const {
+	return close(state.bound_) || (! queue_.full()) || scorer_t::comparator(queue_.last().score(), state.bound_);
+      }
+
+      std::pair<state_t, bool> compute_state(column_t& column) const {
+	std::pair<state_t, bool> result = parent_t::compute_state(column);
+	result.second = accept(result.first);
+	return result;
+      }
+
+      void push(const varset_type& pattern, const state_t& state) {
+	const Entry entry{pattern, state.score_};
+	queue_.push(entry);
+	top_.push(entry);
+	if(close(entry.score())) {
+	  close_.push_back(entry);
+	  // Patterns that got too far from the k-th best one are dropped from time to time
+	  if(close_.size() > 2 * compacted_) {
+	    std::erase_if(close_, [this] (const Entry& e) { return ! close(e.score()); });
+	    compacted_ = std::max(close_.size(), K_);
+	  }
+	}
+      }
+      void pop(const state_t&) {}
+
+      void postprocess(columns_t& columns);
+    };
+
+    template<typename Scorer, typename Columns, typename ReplicateScorer>
+    void SampledTopKProcessor<Scorer, Columns, ReplicateScorer>::postprocess(columns_t&) {
+      cool::Timer timer;
+      timer.start();
+
+      std::vector<Entry> sampled;
+      queue_.purge(std::back_inserter(sampled));
+      for(const Entry& entry : close_)
+	if(close(entry.score())) sampled.push_back(entry);
+      std::sort(sampled.begin(), sampled.end(), [] (const Entry& e1, const Entry& e2) { return e2 < e1; });
+      sampled.erase(std::unique(sampled.begin(), sampled.end(), [] (const Entry& e1, const Entry& e2) { return e1.fields() == e2.fields(); }), sampled.end());
+      const std::vector<score_t> scores = this->rescore(sampled);
+
+      std::vector<Entry> exact;
+      for(size_t index = 0; index != sampled.size(); ++index)
+	exact.emplace_back(sampled[index].fields(), scores[index]);
+      std::sort(exact.begin(), exact.end(), [] (const Entry& e1, const Entry& e2) { return e2 < e1; });
+
+      const size_t K = std::min(K_, exact.size());
+      this->nCandidates_ = static_cast<unsigned int>(sampled.size());
+      for(size_t rank = 0; rank != K; ++rank)
+	if(! (exact[rank].fields() == sampled[rank].fields())) ++this->rankingChanges_;
+      for(size_t rank = 0; rank != K; ++rank)
+	writer_.output_sorted(exact[rank].fields(), exact[rank].score());
+      this->verificationTime_ = timer.stop();
+    }
+
+    /*
+     * Sampled rho search: the patterns of the sample whose scores are within a
+     * relaxed ratio of the best one are rescored exactly, and the ones whose exact
+     * scores are above rho times the best exact score are output.
+     * The number of candidates whose selection changed once rescored is reported as
+     * ranking changes.
+     */
+    template<typename Scorer, typename Columns, typename ReplicateScorer>
+    struct SampledRhoProcessor : SampledProcessor<Scorer, Columns, ReplicateScorer> {
+      using parent_t = SampledProcessor<Scorer, Columns, ReplicateScorer>;
+      using columns_t = typename parent_t::columns_t;
+      using column_t  = typename parent_t::column_t;
+      using scorer_t  = typename parent_t::scorer_t;
+      using score_t   = typename parent_t::score_t;
+      using varset_type  = typename parent_t::varset_type;
+      using state_t = typename parent_t::state_t;
+      using Entry = typename parent_t::Entry;
+      using parent_t::writer_;
+      using parent_t::margin_;
+
+      double rho_, sampleRho_;
+      mutable std::optional<score_t> best_;
+      std::vector<Entry> candidates_;
+
+      SampledRhoProcessor(double rho, double sampleRho, int target, double rate, bool stratified, double confidence, unsigned long seed,
+			  const std::string& inputFileName, std::ostream& output, const scorer_t& scorer, const ReplicateScorer& replicateScorer) :
+	parent_t(target, rate, stratified, confidence, seed, inputFileName, output, scorer, replicateScorer), rho_(rho), sampleRho_(sampleRho), best_{}, candidates_() {}
+
+      score_t lowerBound() const { return sampleRho_ * *best_ - margin_; }
+
+      bool accept(const state_t& state) const {
+	if(best_ && ! scorer_t::comparator(lowerBound(), state.bound_)) return false;
+	if(! best_ || scorer_t::comparator(*best_, state.score_)) best_ = state.score_;
+	return true;
+      }
+
+      std::pair<state_t, bool> compute_state(column_t& column) const {
+	std::pair<state_t, bool> result = parent_t::compute_state(column);
+	result.second = accept(result.first);
+	return result;
+      }
+
+      void push(const varset_type& pattern, const state_t& state) {
+	if(! scorer_t::comparator(state.score_, lowerBound()))
+	  candidates_.emplace_back(pattern, state.score_);
+      }
+      void pop(const state_t&) {}
+
+      void postprocess(columns_t& columns);
+    };
+
+    template<typename Scorer, typename Columns, typename ReplicateScorer>
+    void SampledRhoProcessor<Scorer, Columns, ReplicateScorer>::postprocess(columns_t&) {
+      cool::Timer timer;
+      timer.start();
+
+      // The best score may have increased since early candidates were collected
+      if(best_)
+	std::erase_if(candidates_, [this] (const Entry& entry) { return scorer_t::comparator(entry.score(), lowerBound()); });
+      const std::vector<score_t> scores = this->rescore(candidates_);
+
+      std::optional<score_t> best;
+      for(const score_t& score : scores)
+	if(! best || scorer_t::comparator(*best, score)) best = score;
+      if(! best) {
+	this->verificationTime_ = timer.stop();
+	return;
+      }
+
+      this->nCandidates_ = static_cast<unsigned int>(candidates_.size());
+      for(size_t index = 0; index != candidates_.size(); ++index) {
+	const bool sampledSelection = scorer_t::comparator(rho_ * *best_, candidates_[index].score());
+	const bool exactSelection = scorer_t::comparator(rho_ * *best, scores[index]);
+	if(sampledSelection != exactSelection) ++this->rankingChanges_;
+	if(exactSelection) writer_.output_sorted(candidates_[index].fields(), scores[index]);
+      }
+      this->verificationTime_ = timer.stop();
+    }
+  }
+}
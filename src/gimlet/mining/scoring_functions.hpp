@@ -5,6 +5,8 @@
 #include <cmath>
 #include <cassert>
 #include <algorithm>
+#include <map>
+#include <atomic>
 
 #include <gimlet/itemsets.hpp>
 
@@ -21,6 +23,8 @@ namespace gimlet {
       using size_type = typename Partition::size_type;
       using value_t = Value;
       static const bool has_target = target;
+      /* True if the score only depends on the non-empty parts of the partition, whatever its number of parts */
+      static const bool redundancy_invariant = false;
       
       void begin(size_type) {}      
       void begin(size_type, size_type) {}      
@@ -28,6 +32,8 @@ namespace gimlet {
       void update(size_type) {}
       void subend() {}
       void end() {}
+      /* Smallest number of values of the attributes that can extend the patterns (at least 2) */
+      void setMinValues(size_t) {}
 
       value_t min();
       value_t max();
@@ -306,7 +312,7 @@ namespace gimlet {
       size_type NX_, NY_;
       std::vector<double> nys_;
       
-      inline static size_type bestBound1_ = 0, bestBound2_ = 0;
+      inline static std::atomic<size_type> bestBound1_ = 0, bestBound2_ = 0;
       
     public:
       using value_t = double;
@@ -529,6 +535,8 @@ namespace gimlet {
             
     public:
       using value_t = double;
+      /* The bias is summed over the non-empty parts only */
+      static const bool redundancy_invariant = true;
 
       static bool comparator(value_t v1, value_t v2) {
 	return v1 < v2;
@@ -604,11 +612,24 @@ namespace gimlet {
     class AdjustedDependency : public PartitionScore<Partition, double, true> {
       using size_type = typename Partition::size_type;
 
-      double HX_, HY_, HXY_, alpha_;
-      unsigned long nx_, n_;
+      double HX_, HY_, HXY_, HYx_, alpha_;
+      unsigned long NY_, nx_, n_;
       unsigned long dOfFreedom_;
       double adjustedDependency_, bound_;
       const Partition *partitionY_;
+      bool tightBound_;
+      double growth_;
+      std::vector<double> gains_;
+
+      /* The search of a critical value is linear in the degrees of freedom and the
+	 bound needs several per pattern, out of few distinct ones: they are cached */
+      double bias(unsigned long dOfFreedom) const {
+	thread_local std::map<std::pair<double, unsigned long>, double> criticalValues;
+	auto it = criticalValues.find({alpha_, dOfFreedom});
+	if(it == criticalValues.end())
+	  it = criticalValues.emplace(std::make_pair(alpha_, dOfFreedom), stats::chiTestCriticalValue(alpha_, dOfFreedom)).first;
+	return it->second / (2. * n_);
+      }
             
     public:
       using value_t = double;
@@ -617,7 +638,9 @@ namespace gimlet {
 	return v1 < v2;
       }
 
-      AdjustedDependency(double alpha) : alpha_(alpha) {};
+      AdjustedDependency(double alpha, bool tightBound = true) :
+	HX_(0.), HY_(0.), HXY_(0.), HYx_(0.), alpha_(alpha), NY_(0), nx_(0), n_(0), dOfFreedom_(0),
+	adjustedDependency_(0.), bound_(0.), partitionY_(nullptr), tightBound_(tightBound), growth_(0.), gains_() {};
       AdjustedDependency(const AdjustedDependency&) = default;
       
       void setTarget(const Partition& target) {
@@ -625,27 +648,44 @@ namespace gimlet {
 	Entropy H = Entropy<Partition>{}(*partitionY_);
 	HY_ = H;
 	n_ = H.count();
-	unsigned long NY = target.nParts();
-	dOfFreedom_ = NY - 1;
+	NY_ = target.nParts();
+	dOfFreedom_ = NY_ - 1;
+	if(tightBound_) gains_.resize(NY_ + 1);
 	// std::cerr << "SET DOF = " << dOfFreedom_ << std::endl;	
       }
 
+      /* An attribute with m >= minValues values multiplies the degrees of freedom by
+	 m - 1 >= m^growth_: splitting the parts m-fold multiplies them at least by m^growth_ */
+      void setMinValues(size_t minValues) {
+	growth_ = minValues > 2 ? std::log(minValues - 1.) / std::log(double(minValues)) : 0.;
+      }
+
       void begin(size_type NX, size_type NY) {
 	HX_ = HXY_ = 0;
+	std::fill(gains_.begin(), gains_.end(), 0.);
 	// std::cerr << "UPDATE DOF " << NX << " -> " << dOfFreedom_ << std::endl;
       }
       
       void subbegin() {
 	nx_ = 0.;
+	HYx_ = 0.;
       }
       
       void update(double nxy) {
 	HXY_ += xlogx(nxy);
+	HYx_ += xlogx(nxy);
 	nx_ += nxy;
       }
 
+      /* gains_[m] accumulates nx * min(H(Y|x), log2 m): the largest information gain
+	 that splitting every part of X into m subparts can bring. */
       void subend() {
 	HX_ += xlogx(nx_);
+	if(tightBound_ && nx_ > 0) {
+	  double HYx = std::log2(nx_) - HYx_ / nx_;
+	  for(size_t m = 2; m < gains_.size(); ++m)
+	    gains_[m] += nx_ * std::min(HYx, std::log2(m));
+	}
       }
       
       void end() {
@@ -653,9 +693,25 @@ namespace gimlet {
 	HX_ = logn - HX_ / n_;
 	HXY_ = logn - HXY_ / n_;
 	double info = (HY_ + HX_ - HXY_);
-	double bias = stats::chiTestCriticalValue(alpha_, dOfFreedom_)/ (2. * n_);
+	double bias = this->bias(dOfFreedom_);
 	adjustedDependency_ = (info - bias) / HY_;
-	bound_ = 1. - bias;	
+	/* A specialization splitting the parts of X m-fold gains at most gains_[m] / n while
+	   its degrees of freedom are at least dOfFreedom_ * m^growth_. Beyond m = NY, the gain
+	   is maximal while the bias keeps growing. With binary attributes (growth_ = 0), the
+	   bias does not grow and the bound is 1 - bias / H(Y). The median of a chi-square with
+	   k degrees of freedom exceeds k - 2/3: when alpha <= 0.5, it spares the critical
+	   values of the splits that cannot raise the bound. */
+	if(tightBound_) {
+	  bound_ = adjustedDependency_;
+	  for(size_t m = 2; m < gains_.size(); ++m) {
+	    unsigned long dOfFreedom = std::max(dOfFreedom_, static_cast<unsigned long>(dOfFreedom_ * std::pow(m, growth_)));
+	    double gain = info + gains_[m] / n_;
+	    if(dOfFreedom != dOfFreedom_ && alpha_ <= .5 && (gain - (dOfFreedom - 2. / 3.) / (2. * n_)) / HY_ <= bound_)
+	      continue;
+	    bound_ = std::max(bound_, (gain - this->bias(dOfFreedom)) / HY_);
+	  }
+	} else
+	  bound_ = 1. - bias;	
 	// std::cerr << "info = " << info << std::endl;
 	// std::cerr << "DOF = " << dOfFreedom_ << std::endl;
 	// std::cerr << "bias = " << bias << std::endl;
@@ -680,10 +736,16 @@ namespace gimlet {
     class SuzukiInfo : public PartitionScore<Partition, double, true> {
       using size_type = typename Partition::size_type;
 
-      double HX_, HY_, HXY_;
+      double HX_, HY_, HXY_, HYx_;
       unsigned long NX_, NY_, nx_, n_;
       double suzukiInfo_, bound_;
       const Partition *partitionY_;
+      bool tightBound_;
+      std::vector<double> gains_;
+
+      double bias(double NX) const {
+	return (NX - 1) * (NY_ - 1)/ (2. * n_) * std::log2(n_);
+      }
             
     public:
       using value_t = double;
@@ -692,7 +754,9 @@ namespace gimlet {
 	return v1 < v2;
       }
 
-      SuzukiInfo() = default;
+      SuzukiInfo(bool tightBound = true) :
+	HX_(0.), HY_(0.), HXY_(0.), HYx_(0.), NX_(0), NY_(0), nx_(0), n_(0),
+	suzukiInfo_(0.), bound_(0.), partitionY_(nullptr), tightBound_(tightBound), gains_() {}
       SuzukiInfo(const SuzukiInfo&) = default;
       
       void setTarget(const Partition& target) {
@@ -701,24 +765,35 @@ namespace gimlet {
 	HY_ = H;
 	n_ = H.count();
 	NY_ = target.nParts();
+	if(tightBound_) gains_.resize(NY_ + 1);
       }
 
       void begin(size_type NX, size_type NY) {
 	NX_ = NX;
 	HX_ = HXY_ = 0;
+	std::fill(gains_.begin(), gains_.end(), 0.);
       }
       
       void subbegin() {
 	nx_ = 0.;
+	HYx_ = 0.;
       }
       
       void update(double nxy) {
 	HXY_ += xlogx(nxy);
+	HYx_ += xlogx(nxy);
 	nx_ += nxy;
       }
 
+      /* gains_[m] accumulates nx * min(H(Y|x), log2 m): the largest information gain
+	 that splitting every part of X into m subparts can bring. */
       void subend() {
 	HX_ += xlogx(nx_);
+	if(tightBound_ && nx_ > 0) {
+	  double HYx = std::log2(nx_) - HYx_ / nx_;
+	  for(size_t m = 2; m < gains_.size(); ++m)
+	    gains_[m] += nx_ * std::min(HYx, std::log2(m));
+	}
       }
       
       void end() {
@@ -726,9 +801,15 @@ namespace gimlet {
 	HX_ = logn - HX_ / n_;
 	HXY_ = logn - HXY_ / n_;
 	double info = (HY_ + HX_ - HXY_);
-	double bias = (NX_ - 1) * (NY_ - 1)/ (2. * n_) * std::log2(n_);
-	suzukiInfo_ = (info - bias) / HY_;
-	bound_ = 1. - bias;	
+	suzukiInfo_ = (info - bias(NX_)) / HY_;
+	/* Any specialization multiplies NX by the number m of values of the added attributes.
+	   Beyond m = NY, the gain is maximal while the bias keeps growing. */
+	if(tightBound_) {
+	  bound_ = suzukiInfo_;
+	  for(size_t m = 2; m < gains_.size(); ++m)
+	    bound_ = std::max(bound_, (info + gains_[m] / n_ - bias(NX_ * m)) / HY_);
+	} else
+	  bound_ = 1. - bias(NX_);
 	// std::cerr << "info = " << info << std::endl;
 	// std::cerr << "bias = " << bias << " NX = " << NX_ << std::endl;
       }
@@ -20,7 +20,7 @@ namespace gimlet {
       using statistics_t = Statistics;
       using column_t = typename columns_t::column_t;
       using field_t = typename columns_t::field_t;
-      using varset_type = std::vector<field_t>;
+      using varset_type = typename processor_t::varset_type;
       using state_t = typename processor_t::state_t;
       using field_iterator_t = typename gimlet::NodeList<field_t>::iterator;
       
@@ -38,13 +38,7 @@ namespace gimlet {
       }
       
       VerticalMiner(std::string inputFileName, Processor& processor) : columns_(), processor_(processor), variables_(), stats_(processor.statistics()) {
-	std::istream* is = &std::cin;
-	std::ifstream inputFile;
-	if(! inputFileName.empty()) {
-	  inputFile.open(inputFileName);
-	  is = &inputFile;
-	}
-	columns_.load(*is);
+	processor.load(columns_, inputFileName);
 	processor.preprocess(columns_);
 	selectVariables();
 	
@@ -136,6 +130,7 @@ namespace gimlet {
 	
 	// columns_[target] = std::move(targetCol);
 	stats_.totalTime_ = timer.stop();
+	processor_.postprocess(columns_);
 	stats_.write();
       }
 
@@ -162,10 +157,18 @@ namespace gimlet {
 	column_t col_;
 	field_iterator_t field_;
 	state_t state_;
+	bool cached_, developing_;
 	
-	Extension(column_t col) : col_(std::move(col)), field_() {}	
-	Extension(column_t col, field_iterator_t field) : col_(std::move(col)), field_(field) {}
+	Extension(column_t col) : col_(std::move(col)), field_(), cached_(true), developing_(false) {}	
+	Extension(column_t col, field_iterator_t field) : col_(std::move(col)), field_(field), cached_(true), developing_(false) {}
 	Extension(Extension&&) = default;
+
+	// Frees the column, that will be recomputed from the parent column if ever developed
+	void release() {
+	  if(! cached_) return;
+	  column_t released{std::move(col_)};
+	  cached_ = false;
+	}
       };
       
       Extension extension(const column_t& current) const {
@@ -185,6 +188,30 @@ namespace gimlet {
       using extension_set_t = std::vector<Extension>;
       varset_type pattern_;
       bool opus_;
+      // Pending extensions of the levels of the current path
+      std::vector<extension_set_t*> frontier_;
+
+      // Near the memory limit, releases the columns of all the pending extensions of the path
+      void shrinkFrontier() {
+	for(extension_set_t* extensions : frontier_)
+	  for(Extension& ext : *extensions)
+	    if(! ext.developing_) ext.release();
+      }
+
+      // Develops an extension whose column may have been released to save memory, then releases it
+      void develop(const Extension& current, Extension& ext) {
+	ext.developing_ = true;
+	if(ext.cached_)
+	  mine(ext);
+	else {
+	  ++stats_.recomputedColumns_;
+	  extension_t recomputed = intersect(current.col_, ext.field_);
+	  recomputed.state_ = ext.state_;
+	  mine(recomputed);
+	}
+	ext.developing_ = false;
+	ext.release();
+      }
       
       void mine(const Extension& current) {
 	const field_iterator_t& field = current.field_;
@@ -208,12 +235,17 @@ namespace gimlet {
 #endif
 	  std::tie(ext.state_, accept) = processor_.compute_state(ext.col_);
 	  
-	  if(accept)
+	  if(accept) {
+	    if(cool::MemoryBudget::instance().nearLimit())
+	      ext.release();
 	    extensions.push_back(std::move(ext));
-	  else
+	  } else
 	    removed.push_back(field.remove());
 	}
 
+	if(cool::MemoryBudget::instance().nearLimit()) shrinkFrontier();
+	frontier_.push_back(&extensions);
+
 	std::vector<extension_t*> extensionPtrs;
 	for(extension_t& ext : extensions)
 	  extensionPtrs.push_back(&ext);
@@ -226,7 +258,7 @@ namespace gimlet {
 	  
 	  for(extension_t* ext : extensionPtrs) {
 	    field_iterator_t& field = ext->field_;
-	    if(processor_.accept(ext->state_)) mine(*ext);
+	    if(processor_.accept(ext->state_)) develop(current, *ext);
 	    field.insert();
 	  }
 	  
@@ -234,9 +266,10 @@ namespace gimlet {
 	  for(extension_t* ext : extensionPtrs) {
 	    field_iterator_t& field = ext->field_;
 	    removed.push_back(field.remove());
-	    if(processor_.accept(ext->state_)) mine(*ext);
+	    if(processor_.accept(ext->state_)) develop(current, *ext);
 	  }
 	}
+	frontier_.pop_back();
 	
 	while(! removed.empty()) {
 	  removed.back().insert();
@@ -258,13 +291,13 @@ namespace gimlet {
 	std::tie(ext.state_, accept) = processor_.compute_state(ext.col_);
 	if(accept) mine(ext);	
 	stats_.totalTime_ = timer.stop();
+	processor_.postprocess(columns_);
 	stats_.write();
       }
 
       BranchAndBoundMiner(std::string inputFileName, Processor& processor, bool opus=false) : VerticalMiner<Columns, Processor>(inputFileName, processor), opus_(opus) {}
     };
 
-
     template<typename Columns, typename Processor>
     struct BranchTopMiner : public VerticalMiner<Columns, Processor> {
       using VerticalMiner<Columns, Processor>::processor_t;
@@ -284,10 +317,18 @@ namespace gimlet {
 	column_t col_;
 	field_iterator_t field_;
 	state_t state_;
+	bool cached_, developing_;
 	
-	Extension(column_t col) : col_(std::move(col)), field_() {}	
-	Extension(column_t col, field_iterator_t field) : col_(std::move(col)), field_(field) {}
+	Extension(column_t col) : col_(std::move(col)), field_(), cached_(true), developing_(false) {}	
+	Extension(column_t col, field_iterator_t field) : col_(std::move(col)), field_(field), cached_(true), developing_(false) {}
 	Extension(Extension&&) = default;
+
+	// Frees the column, that will be recomputed from the parent column if ever developed
+	void release() {
+	  if(! cached_) return;
+	  column_t released{std::move(col_)};
+	  cached_ = false;
+	}
       };
       
       Extension extension(const column_t& current) const {
@@ -307,6 +348,31 @@ namespace gimlet {
       using extension_set_t = std::vector<Extension>;
       varset_type pattern_;
       bool accept_score_decrease_, opus_;
+      // Pending extensions of the levels of the current path
+      std::vector<extension_set_t*> frontier_;
+
+      // Near the memory limit, releases the columns of all the pending extensions of the path
+      void shrinkFrontier() {
+	for(extension_set_t* extensions : frontier_)
+	  for(Extension& ext : *extensions)
+	    if(! ext.developing_) ext.release();
+      }
+
+      // Develops an extension whose column may have been released to save memory, then releases it
+      state_t develop(const Extension& current, Extension& ext, const state_t& best_state_from_ancestors) {
+	ext.developing_ = true;
+	state_t best_state = ext.cached_ ? mine(ext, best_state_from_ancestors) : recompute(current, ext, best_state_from_ancestors);
+	ext.developing_ = false;
+	ext.release();
+	return best_state;
+      }
+
+      state_t recompute(const Extension& current, const Extension& ext, const state_t& best_state_from_ancestors) {
+	++stats_.recomputedColumns_;
+	extension_t recomputed = intersect(current.col_, ext.field_);
+	recomputed.state_ = ext.state_;
+	return mine(recomputed, best_state_from_ancestors);
+      }
       
       state_t mine(const Extension& current, state_t best_state_from_ancestors) {
 	if(processor_.worse(best_state_from_ancestors, current.state_))
@@ -332,12 +398,17 @@ namespace gimlet {
 #endif
 	  std::tie(ext.state_, accept) = processor_.compute_state(ext.col_);
 	  
-	  if(accept && (accept_score_decrease_ || processor_.worse_or_equal(current.state_, ext.state_)))
+	  if(accept && (accept_score_decrease_ || processor_.worse_or_equal(current.state_, ext.state_))) {
+	    if(cool::MemoryBudget::instance().nearLimit())
+	      ext.release();
 	    extensions.push_back(std::move(ext));
-	  else
+	  } else
 	    removed.push_back(field.remove());
 	}
 
+	if(cool::MemoryBudget::instance().nearLimit()) shrinkFrontier();
+	frontier_.push_back(&extensions);
+
 	std::vector<extension_t*> extensionPtrs;
 	for(extension_t& ext : extensions)
 	  extensionPtrs.push_back(&ext);
@@ -352,7 +423,7 @@ namespace gimlet {
 	  for(extension_t* ext : extensionPtrs) {
 	    field_iterator_t& field = ext->field_;
 	    if(processor_.accept(ext->state_)) {
-	      state_t best_state = mine(*ext, best_state_from_ancestors);
+	      state_t best_state = develop(current, *ext, best_state_from_ancestors);
 	      if(processor_.worse(best_state_from_offspring, best_state))
 		best_state_from_offspring = best_state;
 	    }
@@ -364,7 +435,7 @@ namespace gimlet {
 	    field_iterator_t& field = ext->field_;
 	    removed.push_back(field.remove());
 	    if(processor_.accept(ext->state_)) {
-	      state_t best_state = mine(*ext, best_state_from_ancestors);
+	      state_t best_state = develop(current, *ext, best_state_from_ancestors);
 	      if(processor_.worse(best_state_from_offspring, best_state))
 		best_state_from_offspring = best_state;
 	    }
@@ -373,6 +444,7 @@ namespace gimlet {
 
 	if(processor_.worse_or_equal(best_state_from_ancestors, current.state_) && processor_.worse_or_equal(best_state_from_offspring, current.state_))
 	  processor_.push(pattern_, current.state_);
+	frontier_.pop_back();
 	
 	while(! removed.empty()) {
 	  removed.back().insert();
@@ -397,6 +469,7 @@ namespace gimlet {
 	std::tie(ext.state_, accept) = processor_.compute_state(ext.col_);
 	if(accept) mine(ext, ext.state_);	
 	stats_.totalTime_ = timer.stop();
+	processor_.postprocess(columns_);
 	stats_.write();
       }
 
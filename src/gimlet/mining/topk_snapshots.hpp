@@ -0,0 +1,67 @@
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <gimlet/json_parser.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    /*
+     * Side stream of the top-k of the running search, for downstream consumers
+     * acting on good enough patterns before the end of long searches. While a
+     * search runs, a background thread takes its current top-k at most once per
+     * interval and appends it as one NDJSON line
+     *   {"time": <seconds since the start>, "patterns": [[pattern, score], ...]}
+     * when it differs from the last line written. A last snapshot is taken when
+     * the search ends. The main output is unchanged.
+     */
+    class TopKSnapshots {
+      std::ofstream file_;
+      std::chrono::duration<double> interval_;
+      std::function<std::string()> take_;
+      std::string last_;
+      std::chrono::steady_clock::time_point start_;
+      std::thread thread_;
+      std::mutex mutex_;
+      std::condition_variable wakeUp_;
+      bool stopping_;
+
+      TopKSnapshots();
+      void run();
+      void write();
+
+    public:
+      static TopKSnapshots& instance();
+
+      /* Writes the snapshots of the searches to fileName, at most one per interval (in seconds) */
+      void open(const std::string& fileName, double interval);
+      bool enabled() const { return file_.is_open(); }
+
+      /*
+       * Starts taking snapshots of a search: take returns its current top-k as
+       * a JSON list (see format()) and is called from the snapshot thread
+       */
+      void start(std::function<std::string()> take);
+      /* Stops the snapshots of the search after a last one */
+      void stop();
+
+      /* JSON text of value written in Format, with the names of the fields if any */
+      template<typename Format, typename Value>
+      static std::string format(const Value& value, const std::vector<std::string>& names) {
+	std::ostringstream os;
+	if(! names.empty()) set_names(os, &names);
+	JSONParser<Format>().write(os, value);
+	return os.str();
+      }
+    };
+  }
+}
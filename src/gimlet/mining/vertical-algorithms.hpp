@@ -23,6 +23,8 @@
  *
  */
 
+#pragma once
+
 #include <iostream>
 #include <string>
 #include <vector>
@@ -33,6 +35,7 @@
 #include <gimlet/statistics.hpp>
 #include <gimlet/topk_queue.hpp>
 #include <gimlet/bin_parser.hpp>
+#include <gimlet/compressed_input.hpp>
 #include <gimlet/data_iterator.hpp>
 
 #include "list.hpp"
@@ -59,7 +62,7 @@ namespace gimlet {
     	}
       };
 
-      using output_format = tuple<list<field_t>, score_t>;
+      using output_format = tuple<list<named<field_t>>, score_t>;
       using parser_t = BIN_typed_flow_t<output_format>;
       using stream_t = output_stream_t<parser_t>;
 
@@ -90,13 +93,8 @@ namespace gimlet {
       }
       
       VerticalMiner(std::string inputFileName, const Scorer& scorer) : columns_(), scorer_(scorer), variables_(), stats_() {
-	std::istream* is = &std::cin;
-	std::ifstream inputFile;
-	if(! inputFileName.empty()) {
-	  inputFile.open(inputFileName);
-	  is = &inputFile;
-	}
-	columns_.load(*is);
+	cool::InputFile inputFile(inputFileName);
+	columns_.load(inputFile);
 	
 	if(debug_) std::clog << columns_ << std::endl;
       }
@@ -112,6 +110,7 @@ namespace gimlet {
       using field_t = typename VerticalMiner<Columns, Scorer>::field_t;
       using field_iterator_t = typename VerticalMiner<Columns, Scorer>::field_iterator_t;
       using score_t = typename VerticalMiner<Columns, Scorer>::score_t;
+      using varset_type = typename VerticalMiner<Columns, Scorer>::varset_type;
     private:
       using VerticalMiner<Columns, Scorer>::variables_;
       using VerticalMiner<Columns, Scorer>::columns_;
@@ -156,7 +155,7 @@ namespace gimlet {
 	for(field_iterator_t field = variables_.begin(), end = variables_.end(); field != end; ++field) {
 	  extension_t ext = intersect(current.col_, columns_[*field]);
 
-	  if(this->scorer_.accept(ext.score_, threshold_)) {
+	  if(Scorer::comparator(ext.score_, threshold_)) {
 #ifdef DEBUG
 	  std::clog << "Keeping " << *field << " -> score = " << ext.score_ << std::endl;
 #endif	
@@ -221,7 +220,8 @@ namespace gimlet {
 	timer.start();
 
 	Extension top{columns_.top()};
-	if(this->scorer_.accept(top.score_, threshold_)) mine(top);
+	top.score_ = scorer_(top.col_);
+	if(Scorer::comparator(top.score_, threshold_)) mine(top);
 	
 	stats_.totalTime_ = timer.stop();
 	stats_.write();
@@ -237,6 +237,7 @@ namespace gimlet {
       using field_t = typename VerticalMiner<Columns, Scorer>::field_t;
       using field_iterator_t = typename VerticalMiner<Columns, Scorer>::field_iterator_t;
       using score_t = typename VerticalMiner<Columns, Scorer>::score_t;
+      using varset_type = typename VerticalMiner<Columns, Scorer>::varset_type;
     private:
       using VerticalMiner<Columns, Scorer>::variables_;
       using VerticalMiner<Columns, Scorer>::columns_;
@@ -345,7 +346,7 @@ namespace gimlet {
 	//	stats_.addDouble("K", &K);
 
        	if(target < 0) target = columns_.size() - 1;
-	column_t targetCol{std::move(columns_[target])};
+	column_t targetCol{columns_.remove(target)};
 	scorer_.setTarget(targetCol);
 	
 	this->selectVariables();
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include <gimlet/type_traits.hpp>
+
+namespace cool {
+
+  /**
+   * small_vector
+   *
+   * Sequence of trivially copyable elements stored inline up to N elements: it
+   * only allocates beyond N, and copies only move the used elements. Longer
+   * sequences are moved to the heap, doubling their capacity as they grow.
+   */
+  template<typename T, size_t N>
+  class small_vector {
+    static_assert(std::is_trivially_copyable_v<T>, "small_vector elements must be trivially copyable");
+
+    size_t size_;
+    size_t capacity_;
+    T* data_;
+    T inline_[N];
+
+    bool inlined() const { return data_ == inline_; }
+
+    void release() {
+      if(! inlined()) delete[] data_;
+    }
+
+    void reserve(size_t capacity) {
+      if(capacity <= capacity_) return;
+      capacity = std::max(capacity, 2 * capacity_);
+      T* data = new T[capacity];
+      std::copy_n(data_, size_, data);
+      release();
+      data_ = data;
+      capacity_ = capacity;
+    }
+
+  public:
+    using value_type = T;
+    using size_type = size_t;
+    using reference = T&;
+    using const_reference = const T&;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    small_vector() : size_(0), capacity_(N), data_(inline_) {}
+    small_vector(const small_vector& other) : small_vector() {
+      reserve(other.size_);
+      size_ = other.size_;
+      std::copy_n(other.data_, size_, data_);
+    }
+    small_vector(small_vector&& other) noexcept : small_vector() {
+      *this = std::move(other);
+    }
+    template<typename Iterator>
+    small_vector(Iterator first, Iterator last) : small_vector() {
+      for(; first != last; ++first) push_back(*first);
+    }
+    ~small_vector() { release(); }
+
+    small_vector& operator=(const small_vector& other) {
+      if(this == &other) return *this;
+      size_ = 0;
+      reserve(other.size_);
+      size_ = other.size_;
+      std::copy_n(other.data_, size_, data_);
+      return *this;
+    }
+    small_vector& operator=(small_vector&& other) noexcept {
+      if(this == &other) return *this;
+      if(other.inlined()) {
+	// Inline elements fit in the current storage, whatever it is
+	size_ = other.size_;
+	std::copy_n(other.data_, size_, data_);
+      } else {
+	release();
+	data_ = other.data_;
+	size_ = other.size_;
+	capacity_ = other.capacity_;
+	other.data_ = other.inline_;
+	other.capacity_ = N;
+      }
+      other.size_ = 0;
+      return *this;
+    }
+
+    /* Conversion used when patterns are written through vector-based output formats */
+    template<typename A>
+    operator std::vector<T, A>() const { return std::vector<T, A>(begin(), end()); }
+
+    /* Number of elements stored without allocating */
+    static constexpr size_t inline_capacity() { return N; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    void clear() { size_ = 0; }
+
+    void push_back(const T& value) {
+      if(size_ == capacity_) {
+	// value may be an element of this vector
+	T copy = value;
+	reserve(size_ + 1);
+	data_[size_++] = copy;
+      } else
+	data_[size_++] = value;
+    }
+    void pop_back() { --size_; }
+
+    T& operator[](size_t index) { return data_[index]; }
+    const T& operator[](size_t index) const { return data_[index]; }
+    T& back() { return data_[size_ - 1]; }
+    const T& back() const { return data_[size_ - 1]; }
+
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    friend bool operator==(const small_vector& v1, const small_vector& v2) {
+      return std::equal(v1.begin(), v1.end(), v2.begin(), v2.end());
+    }
+    friend bool operator<(const small_vector& v1, const small_vector& v2) {
+      return std::lexicographical_compare(v1.begin(), v1.end(), v2.begin(), v2.end());
+    }
+  };
+
+  template<typename T, size_t N>
+  struct is_sequence<small_vector<T,N>> : std::integral_constant<bool, true> {};
+}
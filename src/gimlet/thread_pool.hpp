@@ -3,7 +3,14 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <functional>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
 #include <vector>
 #include <deque>
 #include <iostream>
@@ -11,78 +18,273 @@
 
 namespace cool {
 
+  class ThreadPool;
+  class TaskGroup;
+
+  /*
+   * Type-erased nullary task. Small callables are stored inline and task nodes
+   * are recycled by a per-thread cache, so that posting a task does not allocate.
+   */
+  class Task {
+    friend class ThreadPool;
+    friend class TaskGroup;
+
+    static constexpr size_t inlineSize = 64;
+
+    void (*run_)(Task*);
+    TaskGroup* group_;
+    alignas(std::max_align_t) unsigned char storage_[inlineSize];
+
+    Task() = default;
+    static Task* allocate();
+    static void release(Task* task);
+
+    template<typename F>
+    static void runInline(Task* task) {
+      F* func = std::launder(reinterpret_cast<F*>(task->storage_));
+      struct Guard { F* func_; ~Guard() { func_->~F(); } } guard{func};
+      (*func)();
+    }
+
+    template<typename F>
+    static void runOnHeap(Task* task) {
+      std::unique_ptr<F> func{*std::launder(reinterpret_cast<F**>(task->storage_))};
+      (*func)();
+    }
+
+  public:
+    template<typename Func>
+    static Task* make(Func&& func, TaskGroup* group) {
+      using F = std::decay_t<Func>;
+      Task* task = allocate();
+      task->group_ = group;
+      if constexpr(sizeof(F) <= inlineSize && alignof(F) <= alignof(std::max_align_t)) {
+	new (task->storage_) F(std::forward<Func>(func));
+	task->run_ = &runInline<F>;
+      } else {
+	new (task->storage_) F*(new F(std::forward<Func>(func)));
+	task->run_ = &runOnHeap<F>;
+      }
+      return task;
+    }
+  };
+
+  /*
+   * Chase-Lev work-stealing deque (Le et al., "Correct and efficient work-stealing
+   * for weak memory models", 2013). The owner pushes and pops at the bottom, thieves
+   * steal from the top. Buffers only grow; retired buffers are kept until destruction
+   * since thieves may still read them.
+   */
+  class WorkStealingDeque {
+    class Buffer {
+      size_t mask_;
+      std::unique_ptr<std::atomic<Task*>[]> tasks_;
+    public:
+      Buffer(size_t capacity) : mask_(capacity - 1), tasks_(new std::atomic<Task*>[capacity]) {}
+      size_t capacity() const { return mask_ + 1; }
+      Task* get(int64_t index) const { return tasks_[index & mask_].load(std::memory_order_relaxed); }
+      void put(int64_t index, Task* task) { tasks_[index & mask_].store(task, std::memory_order_relaxed); }
+    };
+
+    std::atomic<int64_t> top_, bottom_;
+    std::atomic<Buffer*> buffer_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+
+    Buffer* grow(Buffer* buffer, int64_t top, int64_t bottom);
+
+  public:
+    WorkStealingDeque(size_t capacity = 256);
+
+    bool empty() const {
+      return bottom_.load(std::memory_order_seq_cst) <= top_.load(std::memory_order_seq_cst);
+    }
+    void push(Task* task);
+    Task* pop();
+    Task* steal();
+  };
+
+  /*
+   * Set of tasks with fork/join semantics: run() forks a task, wait() joins all
+   * of them. The waiting thread executes pending tasks instead of blocking, so
+   * groups can be nested inside tasks of the same pool. The first exception thrown
+   * by a task is rethrown by wait().
+   */
+  class TaskGroup {
+    friend class ThreadPool;
+
+    ThreadPool& pool_;
+    std::atomic<size_t> pending_;
+    std::atomic<bool> failed_;
+    std::exception_ptr exception_;
+    std::mutex mutex_;
+    std::condition_variable done_;
+
+    void complete(std::exception_ptr exception);
+    void waitWithoutThrow();
+
+  public:
+    TaskGroup(ThreadPool& pool);
+    TaskGroup(const TaskGroup&) = delete;
+    ~TaskGroup();
+
+    template<typename Func>
+    void run(Func&& func);
+
+    void wait();
+  };
+
+  /*
+   * Work-stealing thread pool: every worker owns a deque in which it pushes the
+   * tasks it spawns, idle workers steal from others and tasks posted by external
+   * threads go through a shared injection queue.
+   * Pinned workers are bound to the allowed cores, filled NUMA node by NUMA node,
+   * so that the memory they first touch stays local.
+   */
   class ThreadPool {
-    using function = std::function<void()>;
-    std::vector<std::thread> threads_;
-    std::deque<function> tasks_;
+    friend class TaskGroup;
+
+    struct Worker {
+      ThreadPool& pool_;
+      WorkStealingDeque deque_;
+      unsigned long seed_;
+      std::thread thread_;
+
+      Worker(ThreadPool& pool, unsigned long seed) : pool_(pool), deque_(), seed_(seed), thread_() {}
+    };
+
+    static thread_local Worker* current_;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::deque<Task*> injected_;
+    std::atomic<size_t> nInjected_;
     std::mutex mutex_;
     std::condition_variable tasksToDo_;
-    std::condition_variable idle_;
+    std::atomic<unsigned int> nSleeping_;
     bool end_;
-    unsigned int running_;
+    TaskGroup tasks_;
+
+    Worker* self() const { return current_ && &current_->pool_ == this ? current_ : nullptr; }
+    void submit(Task* task);
+    Task* findTask(Worker* worker);
+    bool hasWork() const;
+    void execute(Task* task);
+    void work(Worker& worker);
+
   public:
-    ThreadPool(size_t nThreads);
+    ThreadPool(size_t nThreads, bool pinned = false);
     ~ThreadPool();
 
-    inline size_t size() const { return threads_.size(); }
-    
+    inline size_t size() const { return workers_.size(); }
+
     template<typename Func, typename... Args>
     ThreadPool& operator() (const Func& func, Args... args) {
-      {
-	std::lock_guard<std::mutex> lock(mutex_);
-	if(end_) return *this;
-	tasks_.emplace_back(func, args...);
-      }
-      tasksToDo_.notify_one();
-
+      emplace_back(func, args...);
       return *this;
     }
 
     template<typename Func, typename... Args>
     void emplace_back(const Func& func, Args... args) {
-      {
-	std::lock_guard<std::mutex> lock(mutex_);
-	if(end_) return;
-	tasks_.emplace_back(func, args...);
-      }
-      tasksToDo_.notify_one();
+      if constexpr(sizeof...(Args) == 0)
+	tasks_.run(func);
+      else
+	tasks_.run([func, args...] () { func(args...); });
     }
+
+    /* Waits for all tasks posted with emplace_back, helping to run them */
     void join();
   };
 
+  template<typename Func>
+  void TaskGroup::run(Func&& func) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    pool_.submit(Task::make(std::forward<Func>(func), this));
+  }
+
   inline double timeInMicroSeconds() {
     static auto start = std::chrono::high_resolution_clock::now();
     auto t = std::chrono::high_resolution_clock::now();
     return std::chrono::duration_cast<std::chrono::microseconds>(t - start).count();
   }
-  
-  template<typename Iterator, typename TaskFactory>
-  void run_parallel(const Iterator& begin, const Iterator& end, TaskFactory factory, size_t sizeLimit) {
-    using task_type = decltype(factory(*begin));
 
-    if(begin != end) {
-      std::vector<std::thread> threads;
-      std::vector<task_type> tasks;
-      auto it = begin;
-      tasks.push_back(factory(*it));
-      
-      for(++it; it != end; ++it) {
-	task_type task = factory(*it);
-	size_t s = task.size();
-	if(s > sizeLimit)
-	  threads.emplace_back(task);
-	else
-	  tasks.push_back(std::move(task));
-      }
-      for(auto& task : tasks)
-	task();
+  /*
+   * Number of indices per chunk: at least grain and, by default, about four
+   * chunks per thread of the pool (the calling thread included).
+   */
+  inline size_t chunkSize(const ThreadPool& pool, size_t n, size_t grain) {
+    size_t nChunks = 4 * (pool.size() + 1);
+    return std::max<size_t>(std::max<size_t>(grain, 1), (n + nChunks - 1) / nChunks);
+  }
+
+  /*
+   * Calls body(i) for every i in [begin, end[. Chunks are run by the pool and by
+   * the calling thread, so that concurrency never exceeds the pool size plus one.
+   */
+  template<typename Index, typename Body>
+  void parallel_for(ThreadPool& pool, Index begin, Index end, const Body& body, size_t grain = 0) {
+    if(! (begin < end)) return;
+    const size_t n = end - begin, chunk = chunkSize(pool, n, grain);
+    if(chunk >= n) {
+      for(Index index = begin; index != end; ++index) body(index);
+      return;
+    }
+    TaskGroup group{pool};
+    for(size_t first = 0; first < n; first += chunk) {
+      Index chunkBegin = begin + first, chunkEnd = begin + std::min(n, first + chunk);
+      group.run([&body, chunkBegin, chunkEnd] () {
+	  for(Index index = chunkBegin; index != chunkEnd; ++index) body(index);
+	});
+    }
+    group.wait();
+  }
 
-      for(auto& thread : threads) thread.join();
-      // threads.clear();
-      // tasks.clear();
+  /*
+   * Calls body(*it) for every item of [first, last[ whose cost is given by weight(*it).
+   * Consecutive items are gathered in chunks of at least minWeight, so that light
+   * items are processed sequentially and heavy ones spread over the pool.
+   */
+  template<typename Iterator, typename Body, typename Weight>
+  void parallel_for_each(ThreadPool& pool, Iterator first, Iterator last, const Body& body, const Weight& weight, size_t minWeight) {
+    size_t total = 0;
+    for(Iterator it = first; it != last; ++it) total += weight(*it);
+    const size_t target = chunkSize(pool, total, minWeight);
+    if(target >= total) {
+      for(; first != last; ++first) body(*first);
+      return;
     }
+    TaskGroup group{pool};
+    while(first != last) {
+      Iterator chunkBegin = first;
+      for(size_t size = 0; first != last && size < target; ++first)
+	size += weight(*first);
+      group.run([&body, chunkBegin, chunkEnd = first] () {
+	  for(Iterator it = chunkBegin; it != chunkEnd; ++it) body(*it);
+	});
+    }
+    group.wait();
   }
-  
+
+  /*
+   * Reduces body(chunkBegin, chunkEnd, identity) over chunks of [begin, end[.
+   * Partial results are combined in chunk order whatever the scheduling, so the
+   * result is deterministic for a given chunking (pass a grain to make it also
+   * independent of the pool size).
+   */
+  template<typename Index, typename T, typename Body, typename Combine>
+  T parallel_reduce(ThreadPool& pool, Index begin, Index end, const T& identity, const Body& body, const Combine& combine, size_t grain = 0) {
+    if(! (begin < end)) return identity;
+    const size_t n = end - begin, chunk = chunkSize(pool, n, grain);
+    std::vector<T> partials((n + chunk - 1) / chunk, identity);
+    parallel_for(pool, size_t(0), partials.size(),
+		 [&] (size_t index) {
+		   Index chunkBegin = begin + index * chunk, chunkEnd = begin + std::min(n, (index + 1) * chunk);
+		   partials[index] = body(chunkBegin, chunkEnd, std::move(partials[index]));
+		 }, 1);
+    T result = identity;
+    for(T& partial : partials)
+      result = combine(std::move(result), std::move(partial));
+    return result;
+  }
+
   template<typename Iterator, typename TaskFactory>
   void run(const Iterator& begin, const Iterator& end, TaskFactory factory) {
     using task_type = decltype(factory(*begin));
@@ -91,5 +293,5 @@ namespace cool {
       task_type task = factory(*it);
       task();
     }
-  }  
+  }
 }
@@ -45,6 +45,8 @@ namespace cool {
       return this->size() >= K_;
     }
     
+    size_t maxsize() const { return K_; }
+
     void set_maxsize(size_t K) {
       K_ = K;
       while(this->size() > K) {
@@ -68,6 +70,12 @@ namespace cool {
       return this->front();
     }
 
+    /* Copies the elements, in no particular order, without removing them */
+    template<typename OutputIt>
+    OutputIt copy(OutputIt outIt) const {
+      return std::copy(this->begin(), this->end(), outIt);
+    }
+
     T identity(T elt) { return elt; }
     
     template<typename OutputIt, typename Transform = cool::identity<T>>
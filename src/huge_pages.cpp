@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+#include <gimlet/huge_pages.hpp>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace cool {
+
+  HugePageArena::HugePageArena() : enabled_{false}, used_{false}, mutex_{}, regions_{}, next_{nullptr}, end_{nullptr}, freeBlocks_{} {}
+
+  // Never destroyed: blocks may still be released by other static objects at exit
+  HugePageArena& HugePageArena::instance() {
+    static HugePageArena* arena = new HugePageArena();
+    return *arena;
+  }
+
+  // Powers of two below a huge page, multiples of huge pages beyond
+  size_t HugePageArena::blockSize(size_t bytes) {
+    bytes = std::max(bytes, minBlockSize);
+    if(bytes < hugePageSize) return std::bit_ceil(bytes);
+    return (bytes + hugePageSize - 1) & ~(hugePageSize - 1);
+  }
+
+  bool HugePageArena::owns(const void* ptr) const {
+    const char* address = static_cast<const char*>(ptr);
+    for(auto& region : regions_)
+      if(region.first <= address && address < region.first + region.second) return true;
+    return false;
+  }
+
+  // Maps a new region of at least bytes, aligned on huge pages
+  bool HugePageArena::map(size_t bytes) {
+#ifdef __linux__
+    size_t size = (std::max(bytes, minRegionSize) + hugePageSize - 1) & ~(hugePageSize - 1);
+    void* region = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if(region == MAP_FAILED) {
+      // Over-reserve to align the region on a huge page, then give back the margins
+      void* raw = mmap(nullptr, size + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if(raw == MAP_FAILED) return false;
+      char* begin = static_cast<char*>(raw);
+      char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(begin) + hugePageSize - 1) & ~(hugePageSize - 1));
+      if(aligned != begin) munmap(begin, aligned - begin);
+      if(aligned + size != begin + size + hugePageSize) munmap(aligned + size, begin + size + hugePageSize - (aligned + size));
+#ifdef MADV_HUGEPAGE
+      madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+      region = aligned;
+    }
+    regions_.emplace_back(static_cast<char*>(region), size);
+    next_ = static_cast<char*>(region);
+    end_ = next_ + size;
+    used_.store(true, std::memory_order_release);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void* HugePageArena::allocate(size_t bytes) {
+    if(! enabled() || bytes < minBlockSize) return nullptr;
+    const size_t size = blockSize(bytes);
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<void*>& blocks = freeBlocks_[size];
+    if(! blocks.empty()) {
+      void* block = blocks.back();
+      blocks.pop_back();
+      return block;
+    }
+    if(static_cast<size_t>(end_ - next_) < size) {
+      // The rest of the current region is recycled as free blocks before mapping a new one
+      for(size_t rest = end_ - next_; rest >= minBlockSize; rest = end_ - next_) {
+	size_t restSize = rest >= hugePageSize ? rest & ~(hugePageSize - 1) : std::bit_floor(rest);
+	freeBlocks_[restSize].push_back(next_);
+	next_ += restSize;
+      }
+      if(! map(size)) return nullptr;
+    }
+    void* block = next_;
+    next_ += size;
+    return block;
+  }
+
+  bool HugePageArena::deallocate(void* ptr, size_t bytes) {
+    if(! used_.load(std::memory_order_acquire) || bytes < minBlockSize) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(! owns(ptr)) return false;
+    freeBlocks_[blockSize(bytes)].push_back(ptr);
+    return true;
+  }
+}
@@ -0,0 +1,39 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <gimlet/mapped_file.hpp>
+
+namespace cool {
+
+  MappedFile::MappedFile(const std::string& fileName) : data_(nullptr), size_(0) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if(fd < 0) throw std::runtime_error("Cannot open " + fileName + ": " + std::strerror(errno));
+    struct stat status;
+    if(fstat(fd, &status) != 0) {
+      close(fd);
+      throw std::runtime_error("Cannot read " + fileName + ": " + std::strerror(errno));
+    }
+    // Empty files cannot be mapped
+    if(status.st_size != 0) {
+      void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if(data == MAP_FAILED) {
+	close(fd);
+	throw std::runtime_error("Cannot map " + fileName + ": " + std::strerror(errno));
+      }
+      madvise(data, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(data);
+      size_ = static_cast<size_t>(status.st_size);
+    }
+    close(fd);
+  }
+
+  MappedFile::~MappedFile() {
+    if(data_) munmap(const_cast<char*>(data_), size_);
+  }
+}
@@ -0,0 +1,59 @@
+#include <cctype>
+#include <stdexcept>
+
+#include <gimlet/memory_budget.hpp>
+
+namespace cool {
+
+  namespace {
+    struct PeakMemoryEntry : Statistics::Entry {
+      MemoryBudget::Subsystem subsystem_;
+
+      PeakMemoryEntry(MemoryBudget::Subsystem subsystem) : Entry(MemoryBudget::name(subsystem), "MB"), subsystem_(subsystem) {}
+      virtual void write(std::ostream& os) {
+	os << static_cast<double>(MemoryBudget::instance().peak(subsystem_)) / (1024. * 1024.);
+      }
+    };
+  }
+
+  MemoryBudget::MemoryBudget() : used_{}, peak_{}, total_{0}, limit_(0) {}
+
+  MemoryBudget& MemoryBudget::instance() {
+    static MemoryBudget budget;
+    return budget;
+  }
+
+  const char* MemoryBudget::name(Subsystem subsystem) {
+    switch(subsystem) {
+    case treeNodes: return "peak tree nodes";
+    case treeParts: return "peak tree parts";
+    case partitionCells: return "peak partition cells";
+    case partitionParts: return "peak partition parts";
+    default: return "peak memory";
+    }
+  }
+
+  void MemoryBudget::addStatistics(Statistics& stats, Subsystem subsystem) const {
+    stats.variables_.push_back(std::make_shared<PeakMemoryEntry>(subsystem));
+  }
+
+  size_t parseMemorySize(const std::string& size) {
+    size_t end;
+    unsigned long long value;
+    try {
+      value = std::stoull(size, &end);
+    } catch(const std::logic_error&) {
+      throw std::invalid_argument("Invalid memory size \"" + size + "\"");
+    }
+    if(end + 1 < size.size()) throw std::invalid_argument("Invalid memory size \"" + size + "\"");
+    if(end != size.size()) {
+      switch(std::toupper(static_cast<unsigned char>(size[end]))) {
+      case 'G': value *= 1024; [[fallthrough]];
+      case 'M': value *= 1024; [[fallthrough]];
+      case 'K': value *= 1024; break;
+      default: throw std::invalid_argument("Invalid memory size \"" + size + "\"");
+      }
+    }
+    return static_cast<size_t>(value);
+  }
+}
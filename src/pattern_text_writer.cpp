@@ -0,0 +1,52 @@
+#include <sstream>
+
+#include <gimlet/json_parser.hpp>
+#include <gimlet/mining/pattern_text_writer.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    PatternTextWriter::PatternTextWriter(std::ostream& os) : os_(os), buffer_(), writing_(), written_(), names_(), first_(true) {
+      buffer_.reserve(blockSize + blockSize / 4);
+      writing_.reserve(blockSize + blockSize / 4);
+      buffer_.append("[\n");
+    }
+
+    PatternTextWriter::~PatternTextWriter() {
+      buffer_.append("\n]\n");
+      try {
+	if(written_.valid()) written_.get();
+	os_.write(buffer_.data(), buffer_.size());
+	os_.flush();
+      } catch(...) {
+	// Destructors do not throw: the stream keeps its error state
+      }
+    }
+
+    void PatternTextWriter::flush() {
+      // The previous block must be written before its buffer is reused
+      if(written_.valid()) written_.get();
+      buffer_.swap(writing_);
+      buffer_.clear();
+      written_ = std::async(std::launch::async, [this] () {
+	  os_.write(writing_.data(), writing_.size());
+	});
+    }
+
+    void PatternTextWriter::setNames(const std::vector<std::string>& names) {
+      const JSONParser<gimlet::string> parser;
+      names_.clear();
+      for(const std::string& name : names) {
+	std::ostringstream os;
+	parser.write(os, name);
+	names_.push_back(os.str());
+      }
+    }
+
+    void PatternTextWriter::write(std::string_view element) {
+      beginElement();
+      buffer_.append(element);
+      endElement();
+    }
+  }
+}
@@ -0,0 +1,31 @@
+#include <gimlet/mining/resampling.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    LabelPartition::LabelPartition(const Partition& partition) :
+      labels_(partition.labels()), rows_(), offsets_(), nParts_(static_cast<size_type>(partition.nParts())) {
+      offsets_.resize(partition.nNonEmptyParts() + 1);
+      group();
+    }
+
+    LabelPartition::LabelPartition(std::vector<size_type> labels, size_type nParts, size_type nNonEmptyParts) :
+      labels_(std::move(labels)), rows_(), offsets_(nNonEmptyParts + 1), nParts_(nParts) {
+      group();
+    }
+
+    // Counting sort of rows by label
+    void LabelPartition::group() {
+      std::fill(offsets_.begin(), offsets_.end(), 0);
+      for(size_type label : labels_)
+	++offsets_[label + 1];
+      for(size_t part = 1; part < offsets_.size(); ++part)
+	offsets_[part] += offsets_[part - 1];
+
+      std::vector<size_type> next(offsets_.begin(), offsets_.end() - 1);
+      rows_.resize(labels_.size());
+      for(size_type row = 0; row != labels_.size(); ++row)
+	rows_[next[labels_[row]]++] = row;
+    }
+  }
+}
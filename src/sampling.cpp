@@ -0,0 +1,35 @@
+#include <cmath>
+
+#include <gimlet/mining/sampling.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    RowSampler::RowSampler(double rate, unsigned long seed, std::optional<int> stratum) :
+      rate_(rate), stratum_(stratum), rng_(), uniform_(0., 1.), strata_() {
+      std::seed_seq seq{seed, 2ul};
+      rng_.seed(seq);
+    }
+
+    bool RowSampler::operator()(const row_type& row) {
+      if(! stratum_) return uniform_(rng_) < rate_;
+
+      int field = *stratum_;
+      if(field < 0) {
+	attribute_type maxField = 0;
+	for(const auto& pair : row) maxField = std::max(maxField, pair.first);
+	field += maxField + 1;
+      }
+      auto it = std::find_if(row.begin(), row.end(), [field] (const auto& pair) { return pair.first == field; });
+      if(it == row.end()) throw std::runtime_error("Row without stratum field " + std::to_string(field));
+
+      // The i-th row of a stratum is kept if [start + i rate, start + (i+1) rate[ contains an integer
+      auto [stratum, inserted] = strata_.try_emplace(it->second, Stratum{0., 0});
+      Stratum& s = stratum->second;
+      if(inserted) s.start_ = uniform_(rng_);
+      const double before = std::floor(s.start_ + s.n_ * rate_);
+      ++s.n_;
+      return std::floor(s.start_ + s.n_ * rate_) != before;
+    }
+  }
+}
@@ -77,7 +77,7 @@ namespace cool {
       fullPrinting_ = false;
       
     fileName_ = statisticsFileName;
-    comment_ = comment;
+    comment_ = comment ? comment : "";
     enabled_ = true;
   }
 
@@ -25,48 +25,300 @@
 
 #include "gimlet/thread_pool.hpp"
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef GIMLET_HAS_NUMA
+#include <numa.h>
+#endif
+
 namespace cool {
 
-  ThreadPool::ThreadPool(size_t nThreads) :
-    threads_{}, tasks_{}, mutex_{},
-    tasksToDo_{}, idle_{}, end_{false} , running_{0} {
-      while(nThreads-- != 0) {      
-	threads_.emplace_back([this] () {
-	    std::unique_lock<std::mutex> lock(mutex_);
-
-	    while(true) {
-	      if(! tasks_.empty()) {
-		function task = tasks_.front();
-		tasks_.pop_front();
-
-		++running_;
-		lock.unlock();
-		task();
-		lock.lock();
-		--running_;
-
-		if(tasks_.empty())
-		  idle_.notify_all();
-
-	      } else if(end_) {
-		break;
-	      } else {
-		tasksToDo_.wait(lock);
-	      }
-	    }
-	  });
+  namespace {
+    /* Cores the process may run on, grouped by NUMA node */
+    std::vector<int> allowedCores() {
+      std::vector<int> cores;
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if(sched_getaffinity(0, sizeof(set), &set) == 0)
+	for(int core = 0; core != CPU_SETSIZE; ++core)
+	  if(CPU_ISSET(core, &set)) cores.push_back(core);
+#ifdef GIMLET_HAS_NUMA
+      if(numa_available() != -1)
+	std::stable_sort(cores.begin(), cores.end(),
+			 [] (int core1, int core2) { return numa_node_of_cpu(core1) < numa_node_of_cpu(core2); });
+#endif
+#endif
+      return cores;
+    }
+
+    void pin(std::thread& thread, int core) {
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(core, &set);
+      pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+    }
+
+    /* Per-thread cache of task nodes */
+    struct TaskCache {
+      static constexpr size_t capacity = 1024;
+      std::vector<Task*> tasks_;
+      ~TaskCache() { for(Task* task : tasks_) ::operator delete(task); }
+    };
+    thread_local TaskCache taskCache;
+  }
+
+  Task* Task::allocate() {
+    std::vector<Task*>& tasks = taskCache.tasks_;
+    if(tasks.empty()) return static_cast<Task*>(::operator new(sizeof(Task)));
+    Task* task = tasks.back();
+    tasks.pop_back();
+    return task;
+  }
+
+  void Task::release(Task* task) {
+    std::vector<Task*>& tasks = taskCache.tasks_;
+    if(tasks.size() < TaskCache::capacity)
+      tasks.push_back(task);
+    else
+      ::operator delete(task);
+  }
+
+  WorkStealingDeque::WorkStealingDeque(size_t capacity) :
+    top_{0}, bottom_{0}, buffer_{nullptr}, buffers_{} {
+      buffers_.emplace_back(new Buffer{capacity});
+      buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+    }
+
+  WorkStealingDeque::Buffer* WorkStealingDeque::grow(Buffer* buffer, int64_t top, int64_t bottom) {
+    Buffer* bigger = new Buffer{2 * buffer->capacity()};
+    for(int64_t index = top; index != bottom; ++index)
+      bigger->put(index, buffer->get(index));
+    buffers_.emplace_back(bigger);
+    buffer_.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  void WorkStealingDeque::push(Task* task) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    if(bottom - top > static_cast<int64_t>(buffer->capacity()) - 1)
+      buffer = grow(buffer, top, bottom);
+    buffer->put(bottom, task);
+    // Release store rather than a release fence: same ordering, also seen by ThreadSanitizer
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  Task* WorkStealingDeque::pop() {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+
+    Task* task = nullptr;
+    if(top <= bottom) {
+      task = buffer->get(bottom);
+      if(top == bottom) {
+	// Last task: race against thieves
+	if(! top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	  task = nullptr;
+	bottom_.store(bottom + 1, std::memory_order_relaxed);
+      }
+    } else
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return task;
+  }
+
+  Task* WorkStealingDeque::steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = bottom_.load(std::memory_order_acquire);
+
+    if(top < bottom) {
+      Buffer* buffer = buffer_.load(std::memory_order_acquire);
+      Task* task = buffer->get(top);
+      if(top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	return task;
+    }
+    return nullptr;
+  }
+
+  TaskGroup::TaskGroup(ThreadPool& pool) :
+    pool_(pool), pending_{0}, failed_{false}, exception_{}, mutex_{}, done_{} {}
+
+  TaskGroup::~TaskGroup() {
+    waitWithoutThrow();
+  }
+
+  void TaskGroup::complete(std::exception_ptr exception) {
+    if(exception && ! failed_.exchange(true))
+      exception_ = exception;
+    size_t pending = pending_.load(std::memory_order_relaxed);
+    while(pending > 1)
+      if(pending_.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel))
+	return;
+    // Last task: decrement under the lock so that the group outlives the notification
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.fetch_sub(1, std::memory_order_acq_rel);
+    done_.notify_all();
+  }
+
+  void TaskGroup::waitWithoutThrow() {
+    ThreadPool::Worker* worker = pool_.self();
+    while(pending_.load(std::memory_order_acquire) != 0) {
+      if(Task* task = pool_.findTask(worker)) {
+	pool_.execute(task);
+	continue;
+      }
+      // Nothing to help with: remaining tasks are running elsewhere
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait_for(lock, std::chrono::milliseconds(1),
+		     [this] () { return pending_.load(std::memory_order_acquire) == 0; });
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+  }
+
+  void TaskGroup::wait() {
+    waitWithoutThrow();
+    if(failed_.load()) {
+      std::exception_ptr exception = exception_;
+      exception_ = nullptr;
+      failed_.store(false);
+      std::rethrow_exception(exception);
+    }
+  }
+
+  thread_local ThreadPool::Worker* ThreadPool::current_ = nullptr;
+
+  ThreadPool::ThreadPool(size_t nThreads, bool pinned) :
+    workers_{}, injected_{}, nInjected_{0}, mutex_{},
+    tasksToDo_{}, nSleeping_{0}, end_{false}, tasks_{*this} {
+      for(size_t index = 0; index != nThreads; ++index)
+	workers_.emplace_back(new Worker{*this, 2 * index + 1});
+      std::vector<int> cores;
+      if(pinned) cores = allowedCores();
+      for(size_t index = 0; index != nThreads; ++index) {
+	Worker& worker = *workers_[index];
+	worker.thread_ = std::thread([this, &worker] () { work(worker); });
+	if(! cores.empty()) pin(worker.thread_, cores[index % cores.size()]);
       }
     }
 
   ThreadPool::~ThreadPool() {
-    end_ = true;
+    tasks_.waitWithoutThrow();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      end_ = true;
+    }
     tasksToDo_.notify_all();
-    for(auto& thread : threads_) thread.join();
+    for(auto& worker : workers_) worker->thread_.join();
   }
 
   void ThreadPool::join() {
-    std::unique_lock<std::mutex> lock(mutex_);
-    while(! tasks_.empty() || running_ > 0)
-      idle_.wait(lock);
+    tasks_.wait();
+  }
+
+  void ThreadPool::submit(Task* task) {
+    if(Worker* worker = self())
+      worker->deque_.push(task);
+    else {
+      std::lock_guard<std::mutex> lock(mutex_);
+      injected_.push_back(task);
+      nInjected_.fetch_add(1);
+    }
+    // Pairs with the sleeping protocol of work()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(nSleeping_.load() != 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasksToDo_.notify_one();
+    }
+  }
+
+  Task* ThreadPool::findTask(Worker* worker) {
+    if(worker)
+      if(Task* task = worker->deque_.pop())
+	return task;
+
+    if(nInjected_.load() != 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(! injected_.empty()) {
+	Task* task = injected_.front();
+	injected_.pop_front();
+	nInjected_.fetch_sub(1);
+	return task;
+      }
+    }
+
+    const size_t nWorkers = workers_.size();
+    if(nWorkers != 0) {
+      size_t start = 0;
+      if(worker) {
+	// xorshift to pick the first victim
+	worker->seed_ ^= worker->seed_ << 13;
+	worker->seed_ ^= worker->seed_ >> 7;
+	worker->seed_ ^= worker->seed_ << 17;
+	start = worker->seed_ % nWorkers;
+      }
+      for(size_t offset = 0; offset != nWorkers; ++offset) {
+	Worker& victim = *workers_[(start + offset) % nWorkers];
+	if(&victim == worker) continue;
+	if(Task* task = victim.deque_.steal())
+	  return task;
+      }
+    }
+    return nullptr;
+  }
+
+  bool ThreadPool::hasWork() const {
+    if(nInjected_.load() != 0) return true;
+    for(const auto& worker : workers_)
+      if(! worker->deque_.empty()) return true;
+    return false;
+  }
+
+  void ThreadPool::execute(Task* task) {
+    TaskGroup* group = task->group_;
+    std::exception_ptr exception;
+    try {
+      task->run_(task);
+    } catch(...) {
+      exception = std::current_exception();
+    }
+    Task::release(task);
+    group->complete(exception);
+  }
+
+  void ThreadPool::work(Worker& worker) {
+    current_ = &worker;
+    unsigned int nFailures = 0;
+
+    while(true) {
+      if(Task* task = findTask(&worker)) {
+	execute(task);
+	nFailures = 0;
+      } else if(++nFailures < 64) {
+	std::this_thread::yield();
+      } else {
+	nFailures = 0;
+	std::unique_lock<std::mutex> lock(mutex_);
+	nSleeping_.fetch_add(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(! hasWork()) {
+	  if(end_) {
+	    nSleeping_.fetch_sub(1);
+	    break;
+	  }
+	  tasksToDo_.wait(lock);
+	}
+	nSleeping_.fetch_sub(1);
+      }
+    }
+    current_ = nullptr;
   }
 }
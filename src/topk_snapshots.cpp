@@ -0,0 +1,60 @@
+#include <iomanip>
+#include <stdexcept>
+
+#include <gimlet/mining/topk_snapshots.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+
+    TopKSnapshots::TopKSnapshots() : file_(), interval_(1.), take_(), last_(), start_(), thread_(), mutex_(), wakeUp_(), stopping_(false) {}
+
+    TopKSnapshots& TopKSnapshots::instance() {
+      static TopKSnapshots snapshots;
+      return snapshots;
+    }
+
+    void TopKSnapshots::open(const std::string& fileName, double interval) {
+      if(interval <= 0.) throw std::invalid_argument("Snapshot interval must be positive");
+      file_.open(fileName, std::ios::out | std::ios::binary);
+      if(! file_) throw std::runtime_error("Cannot open snapshot file " + fileName);
+      interval_ = std::chrono::duration<double>(interval);
+      start_ = std::chrono::steady_clock::now();
+    }
+
+    void TopKSnapshots::start(std::function<std::string()> take) {
+      if(! enabled()) return;
+      stop();
+      take_ = std::move(take);
+      stopping_ = false;
+      thread_ = std::thread([this] () { run(); });
+    }
+
+    void TopKSnapshots::stop() {
+      if(! thread_.joinable()) return;
+      {
+	std::lock_guard<std::mutex> lock(mutex_);
+	stopping_ = true;
+      }
+      wakeUp_.notify_one();
+      thread_.join();
+      write();
+      take_ = nullptr;
+    }
+
+    void TopKSnapshots::run() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while(! wakeUp_.wait_for(lock, interval_, [this] () { return stopping_; }))
+	write();
+    }
+
+    void TopKSnapshots::write() {
+      std::string patterns = take_();
+      if(patterns == last_) return;
+      const std::chrono::duration<double> time = std::chrono::steady_clock::now() - start_;
+      file_ << "{\"time\": " << std::fixed << std::setprecision(3) << time.count() << std::defaultfloat
+	    << ", \"patterns\": " << patterns << "}\n";
+      file_.flush();
+      last_ = std::move(patterns);
+    }
+  }
+}
@@ -0,0 +1,11 @@
+#include <gimlet/mining/data_partition.hpp>
+#include <gimlet/mining/scoring_functions.hpp>
+#include <gimlet/mining/vertical-algorithms.hpp>
+
+namespace gimlet {
+  namespace itemsets {
+    // The miners are instantiated here for the scores they were written for, so that the library keeps compiling them
+    template struct MonotonicMiner<Partitions, Entropy<Partition>>;
+    template struct TopKMiner<Partitions, ReliableFractionOfInformation<Partition>>;
+  }
+}
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include <gimlet/thread_pool.hpp>
+#include <gimlet/concurrent_topk.hpp>
+
+/*
+ * Pushes random scores with many ties into a concurrent_topk from the threads
+ * of a pool and checks that purge() outputs the K first entries of a sequential
+ * sort with the same tie-break, whatever the number of threads.
+ */
+namespace {
+
+  struct Entry {
+    double score_;
+    unsigned int pattern_;
+
+    double score() const { return score_; }
+    /* Ties are broken by patterns, as in the top-k of the miners */
+    bool operator<(const Entry& other) const {
+      if(score_ < other.score_) return true;
+      if(other.score_ < score_) return false;
+      return other.pattern_ < pattern_;
+    }
+    bool operator==(const Entry& other) const = default;
+  };
+
+  /* Scores are multiples of 1/4 out of 16 values: most entries tie, at the cutoff too */
+  std::vector<Entry> randomEntries(size_t n, unsigned long seed) {
+    std::mt19937_64 generator{seed};
+    std::uniform_int_distribution<int> score{0, 15};
+    std::vector<Entry> entries;
+    for(unsigned int pattern = 0; pattern != n; ++pattern)
+      entries.push_back({ score(generator) / 4., pattern });
+    std::shuffle(entries.begin(), entries.end(), generator);
+    return entries;
+  }
+
+  std::vector<Entry> sequentialTopK(std::vector<Entry> entries, size_t K) {
+    std::sort(entries.begin(), entries.end(), [] (const Entry& e1, const Entry& e2) { return e2 < e1; });
+    entries.resize(std::min(K, entries.size()));
+    return entries;
+  }
+
+  /* With Snapshots, another thread copies the top-k all along the pushes */
+  template<bool Snapshots>
+  void check(size_t nThreads, size_t K, size_t n, unsigned long seed) {
+    const std::string name = "concurrent_topk" + std::string(Snapshots ? " with snapshots" : "") +
+      " (" + std::to_string(nThreads) + " threads, K = " + std::to_string(K) + ", seed " + std::to_string(seed) + "): ";
+    const std::vector<Entry> entries = randomEntries(n, seed);
+    const std::vector<Entry> expected = sequentialTopK(entries, K);
+    cool::concurrent_topk<Entry, std::less<double>, Snapshots> topk{K};
+
+    std::atomic<bool> done{false}, badSnapshot{false};
+    std::thread reader;
+    if constexpr(Snapshots)
+      reader = std::thread([&] () {
+	  while(! done.load()) {
+	    std::vector<Entry> snapshot;
+	    topk.snapshot(std::back_inserter(snapshot));
+	    if(snapshot.size() > K || ! std::is_sorted(snapshot.rbegin(), snapshot.rend()))
+	      badSnapshot.store(true);
+	  }
+	});
+    {
+      cool::ThreadPool pool{nThreads};
+      cool::parallel_for(pool, size_t(0), entries.size(), [&] (size_t index) {
+	  topk.push(entries[index]);
+	}, 16);
+    }
+    done.store(true);
+    if(reader.joinable()) reader.join();
+
+    if(badSnapshot.load())
+      throw std::runtime_error(name + "a snapshot is not a sorted top-k");
+    // The pruning threshold never exceeds the K-th best score
+    if(! topk.accepts(expected.back().score() + .25))
+      throw std::runtime_error(name + "the threshold exceeds the K-th best score");
+    std::vector<Entry> result;
+    topk.purge(std::back_inserter(result));
+    if(result != expected)
+      throw std::runtime_error(name + "purge() differs from the sequential top-k");
+  }
+}
+
+int main() {
+  try {
+    for(size_t nThreads : { 1, 2, 4, 8 })
+      for(size_t K : { 1, 10, 100 })
+	for(unsigned long seed = 1; seed != 4; ++seed) {
+	  check<false>(nThreads, K, 20000, seed);
+	  check<true>(nThreads, K, 20000, seed);
+	}
+    return EXIT_SUCCESS;
+  } catch(const std::exception& ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <vector>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include <gimlet/thread_pool.hpp>
+
+/*
+ * Work stealing of cool::ThreadPool: a deque emptied by its owner and thieves at
+ * once, and nested task groups forked and joined from the tasks of the pool.
+ */
+namespace {
+
+  /*
+   * The owner pushes n tasks, popping one out of three, while thieves steal:
+   * every task must be taken exactly once. Tasks are never run, only addresses
+   * of tokens are passed around.
+   */
+  void checkDeque(size_t nThieves, size_t n) {
+    const std::string name = "WorkStealingDeque (" + std::to_string(nThieves) + " thieves): ";
+    std::vector<unsigned char> tokens(n);
+    std::vector<std::atomic<unsigned int>> taken(n);
+    std::atomic<size_t> nTaken{0};
+    cool::WorkStealingDeque deque{4};
+
+    auto take = [&] (cool::Task* task) {
+      taken[reinterpret_cast<unsigned char*>(task) - tokens.data()].fetch_add(1);
+      nTaken.fetch_add(1);
+    };
+
+    std::vector<std::thread> thieves;
+    for(size_t thief = 0; thief != nThieves; ++thief)
+      thieves.emplace_back([&] () {
+	  while(nTaken.load() != n)
+	    if(cool::Task* task = deque.steal()) take(task);
+	});
+    for(size_t index = 0; index != n; ++index) {
+      deque.push(reinterpret_cast<cool::Task*>(&tokens[index]));
+      if(index % 3 == 0)
+	if(cool::Task* task = deque.pop()) take(task);
+    }
+    while(cool::Task* task = deque.pop()) take(task);
+    for(std::thread& thief : thieves) thief.join();
+
+    for(size_t index = 0; index != n; ++index)
+      if(taken[index].load() != 1)
+	throw std::runtime_error(name + "task " + std::to_string(index) + " taken " + std::to_string(taken[index].load()) + " times");
+  }
+
+  /* Counts the tasks of a tree of nested groups of the given fanout and depth */
+  size_t countTasks(cool::ThreadPool& pool, size_t fanout, size_t depth) {
+    if(depth == 0) return 1;
+    std::vector<size_t> counts(fanout, 0);
+    cool::TaskGroup group{pool};
+    for(size_t child = 0; child != fanout; ++child)
+      group.run([&pool, &counts, fanout, depth, child] () { counts[child] = countTasks(pool, fanout, depth - 1); });
+    group.wait();
+    return std::accumulate(counts.begin(), counts.end(), size_t(1));
+  }
+
+  /* Tasks failing deep in the tree: the exception goes up through every wait() */
+  void failAt(cool::ThreadPool& pool, size_t fanout, size_t depth) {
+    if(depth == 0) throw std::runtime_error("leaf");
+    cool::TaskGroup group{pool};
+    for(size_t child = 0; child != fanout; ++child)
+      group.run([&pool, fanout, depth] () { failAt(pool, fanout, depth - 1); });
+    group.wait();
+  }
+
+  void checkNestedGroups(size_t nThreads) {
+    const std::string name = "TaskGroup (" + std::to_string(nThreads) + " threads): ";
+    cool::ThreadPool pool{nThreads};
+    for(size_t round = 0; round != 4; ++round) {
+      // 4^0 + 4^1 + ... + 4^6 tasks
+      size_t count = countTasks(pool, 4, 6);
+      if(count != 5461)
+	throw std::runtime_error(name + std::to_string(count) + " tasks run instead of 5461");
+    }
+    bool thrown = false;
+    try {
+      failAt(pool, 3, 4);
+    } catch(const std::runtime_error& ex) {
+      thrown = std::string(ex.what()) == "leaf";
+    }
+    if(! thrown)
+      throw std::runtime_error(name + "the exception of a nested task is lost");
+    // The pool is still usable after a failure
+    if(countTasks(pool, 4, 3) != 85)
+      throw std::runtime_error(name + "wrong count after a failure");
+  }
+}
+
+int main() {
+  try {
+    for(size_t nThieves : { 1, 3, 7 })
+      checkDeque(nThieves, 100000);
+    for(size_t nThreads : { 0, 1, 2, 4, 8 })
+      checkNestedGroups(nThreads);
+    return EXIT_SUCCESS;
+  } catch(const std::exception& ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}